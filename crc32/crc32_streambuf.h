@@ -0,0 +1,50 @@
+#pragma once
+
+#ifndef CRC32_STREAMBUF_H_
+#define CRC32_STREAMBUF_H_
+
+#include "crc32.h"
+
+#include <streambuf>
+
+namespace marslander::checksum {
+
+// Passes whatever is written through on to another stream buffer,
+// updating a checksum of it on the way; it has no buffer of its own, so
+// the checksum is up to date as soon as a write returns.
+class crc32_streambuf final : public std::streambuf {
+
+  std::streambuf* _sb;
+  crc32 _crc;
+
+public:
+
+  explicit crc32_streambuf(std::streambuf* sb) : _sb{sb} {}
+
+  crc32_t checksum() const noexcept { return _crc; }
+
+  void reset(crc32_t c = crc32_t{}) noexcept { _crc.reset(c); }
+
+protected:
+
+  std::streamsize xsputn(const char_type* s, std::streamsize n) override {
+    auto written = _sb->sputn(s, n);
+    if (written > 0) _crc.update(s, size_t(written));
+    return written;
+  }
+
+  int_type overflow(int_type ch) override {
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+      return traits_type::not_eof(ch);
+
+    auto c = traits_type::to_char_type(ch);
+    return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+  }
+
+  int sync() override { return _sb->pubsync(); }
+
+};
+
+} // namespace marslander::checksum
+
+#endif // CRC32_STREAMBUF_H_
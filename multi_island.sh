@@ -0,0 +1,49 @@
+#!/bin/bash
+
+# Runs a federation of trainer islands on the local machine in place of
+# several hosts: island N works in ./island_N, listens at <base port> + N,
+# sends migrants to island N+1 (in a ring) and gets its own runners.
+# An island without training.dat is initialized with answers to --init
+# prompts taken from ./island_N/init.txt.
+#
+# Usage: multi_island.sh <config> <islands> <runners per island> \
+#   [<base port> [trainer options...]]
+
+config=$1
+islands_count=$2
+runners_count=$3
+base_port=${4:-12345}
+shift $(( $# < 4 ? $# : 4 ))
+
+trainer_path=$(realpath "./build/$config/trainer")
+runner_path=$(realpath "./build/$config/runner")
+make check trainer runner BUILD_CONFIG=$config
+
+trap terminate SIGINT
+terminate(){
+  pkill -SIGKILL -P $$
+  exit
+}
+
+for (( i = 0; i < islands_count; ++i )); do
+  port=$((base_port + i))
+  peer_port=$((base_port + (i + 1) % islands_count))
+  dir="island_$i"
+  mkdir -p "$dir"
+
+  init_file=/dev/null
+  init_flag=
+  if [[ ! -f "$dir/training.dat" ]]; then
+    init_file="$dir/init.txt"
+    init_flag=--init
+  fi
+
+  (cd "$dir" && exec "$trainer_path" -p $port \
+    --island=localhost:$peer_port $init_flag "$@") < "$init_file" &
+
+  for (( j = 0; j < runners_count; ++j )); do
+    "$runner_path" -p $port &
+  done
+done
+
+wait
@@ -2,9 +2,12 @@
 #include "global_includes.h"
 
 #include "sockpp/stream_socket.h"
+#include "sockpp/tcp_connector.h"
 
 #include <google/protobuf/arena.h>
 
+#include <netinet/tcp.h>
+
 #include <memory>
 #include <vector>
 
@@ -39,6 +42,107 @@ response read_response(sockpp::stream_socket& sock) {
 
 } // namespace detail_
 
+shared_ptr<session::channel> session::open() {
+  tcp_connector conn(_addr);
+  if (!conn) throw io::transfer_error(conn);
+
+  auto marker = io::session_marker;
+  if (conn.write_n(&marker, sizeof(marker)) != ssize_t(sizeof(marker)))
+    throw io::transfer_error(conn);
+
+  uint32_t echo;
+  auto n = conn.read_n(&echo, sizeof(echo));
+  if (n < 0) throw io::transfer_error(conn);
+  if (n != ssize_t(sizeof(echo)) || echo != marker) {
+    SPDLOG_LOGGER_INFO(detail_::logger(), "{} doesn't support sessions; "
+      "falling back to a connection per request.", _addr);
+    _one_shot = true;
+    return nullptr;
+  }
+
+  // Frames are written whole; small ones shouldn't wait for acks.
+  conn.set_option(IPPROTO_TCP, TCP_NODELAY, 1);
+
+  auto ch = make_shared<channel>();
+  ch->wr = stream_socket(conn.release());
+  ch->rd = ch->wr.clone();
+  ch->reading = false;
+  ch->broken = false;
+  SPDLOG_LOGGER_INFO(detail_::logger(), "{} < Session opened", _addr);
+  return ch;
+}
+
+void session::enlist(channel& ch, uint32_t id, channel::waiter& w) {
+  lock_guard lk(ch.m);
+  ch.waiting.emplace(id, &w);
+}
+
+// The reader, if any, fails once the connection is shut down, and wakes
+// the other waiters with it.
+void session::abandon(channel& ch, uint32_t id) {
+  {
+    lock_guard lk(ch.m);
+    ch.waiting.erase(id);
+    ch.broken = true;
+  }
+  ch.wr.shutdown(SHUT_RDWR);
+}
+
+response session::wait(channel& ch, uint32_t id, channel::waiter& w) {
+  unique_lock lk(ch.m);
+
+  // Leaving waiters pass the reader role on, or wake everyone up to
+  // learn the connection is lost.
+  auto leave = [&ch, id] {
+    ch.waiting.erase(id);
+    if (ch.broken) {
+      for (auto& [_, other] : ch.waiting) other->cv.notify_one();
+    }
+    else if (!ch.reading && !ch.waiting.empty())
+      ch.waiting.begin()->second->cv.notify_one();
+  };
+
+  for (;;) {
+    if (w.r) {
+      leave();
+      return move(*w.r);
+    }
+    if (ch.broken) {
+      leave();
+      throw io::transfer_error("Session connection lost.");
+    }
+    if (ch.reading) {
+      w.cv.wait(lk);
+      continue;
+    }
+
+    ch.reading = true;
+    lk.unlock();
+    uint32_t response_id;
+    std::vector<io::any_message> messages;
+    auto arena = std::make_unique<google::protobuf::Arena>();
+    try {
+      if (!io::read_frame(ch.rd, factory_, arena.get(), response_id,
+          messages))
+        throw io::transfer_error("Session closed by the trainer.");
+    }
+    catch (...) {
+      lk.lock();
+      ch.reading = false;
+      ch.broken = true;
+      leave();
+      throw;
+    }
+    lk.lock();
+    ch.reading = false;
+
+    if (auto it = ch.waiting.find(response_id); it != ch.waiting.end()) {
+      it->second->r.emplace(std::move(arena), std::move(messages));
+      it->second->cv.notify_one();
+    }
+  }
+}
+
 } // namespace client
 
 } // namespace marslander::runner
@@ -2,7 +2,14 @@
 
 #include "sockpp/tcp_connector.h"
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <thread>
@@ -68,6 +75,91 @@ response request(const sockpp::inet_address& addr) {
   return request(addr, T0(), Ts()...);
 }
 
+// Requests go through one long-lived connection, opened on first use and
+// again after it breaks; each response is matched to its request by id,
+// so requests may be made from several threads at once. With a trainer
+// that doesn't know sessions (or when asked to), every request opens a
+// connection of its own.
+class session final {
+
+  // A connection of the session. One waiter at a time reads frames off
+  // it, unlocked, and hands each response to the waiter of its id; the
+  // reader role passes on to another waiter when the reader's own
+  // response has come.
+  struct channel final {
+    struct waiter final {
+      std::condition_variable cv;
+      std::optional<response> r;
+    };
+
+    sockpp::stream_socket wr, rd;
+    std::mutex m;
+    std::map<uint32_t, waiter*> waiting;
+    bool reading;
+    std::atomic_bool broken;
+  };
+
+  const sockpp::inet_address _addr;
+  std::atomic_bool _one_shot;
+
+  std::mutex _m;
+  std::shared_ptr<channel> _ch;
+  uint32_t _next_id;
+
+  std::shared_ptr<channel> open();
+  static void enlist(channel& ch, uint32_t id, channel::waiter& w);
+  static void abandon(channel& ch, uint32_t id);
+  static response wait(channel& ch, uint32_t id, channel::waiter& w);
+
+public:
+
+  explicit session(const sockpp::inet_address& addr, bool one_shot = false)
+    : _addr{addr}, _one_shot{one_shot}, _next_id{} {}
+
+  template<typename... Ts>
+  response request(const Ts&... msgs) {
+    std::shared_ptr<channel> ch;
+    uint32_t id;
+    channel::waiter w;
+    {
+      std::lock_guard lk(_m);
+      if (!_one_shot && (!_ch || _ch->broken)) _ch = open();
+      if (!_one_shot) {
+        ch = _ch;
+        id = _next_id++;
+        // Enlisted first, as the response may be read by another waiter
+        // as soon as the request is out.
+        enlist(*ch, id, w);
+        try { io::write_frame(ch->wr, id, msgs...); }
+        catch (...) {
+          abandon(*ch, id);
+          throw;
+        }
+      }
+    }
+    if (!ch) return client::request(_addr, msgs...);
+
+    SPDLOG_LOGGER_TRACE(detail_::logger(), "{} < Request #{} sent",
+      _addr, id);
+    auto r = wait(*ch, id, w);
+    if (r.empty()) throw std::logic_error("Empty response unacceptable.");
+    SPDLOG_LOGGER_TRACE(detail_::logger(),
+      "{} > Response #{} received ({} messages)", _addr, id, r.size());
+    return r;
+  }
+
+  template<typename T0, typename... Ts,
+  std::enable_if_t<
+    std::conjunction_v<std::is_default_constructible<T0>,
+      std::is_default_constructible<Ts>...>,
+    bool
+  > = true>
+  response request() {
+    return request(T0(), Ts()...);
+  }
+
+};
+
 } // namespace client
 
 } // namespace marslander::runner
@@ -114,9 +114,16 @@ void replay_exporter::do_export(size_t generation, uid_t gid, uid_t cid,
           return;
         }
 
-        game_init_input& init = state;
-        dstf_ << PRETTY_JSON
-        << JSON_REPLAY(cid, gid, o, state.to_base64(), init, turns);
+        json_stream js(dstf_, 2);
+        js.begin_object()
+          .field("case_id", cid)
+          .field("gene_id", gid)
+          .field("outcome", o)
+          .field("state", state.to_base64())
+          .field("surface", static_cast<const game_init_input&>(state))
+          .key("turns").begin_array();
+        for (auto& turn : turns) js.value(turn);
+        js.end_array().end_object();
       }
       SPDLOG_LOGGER_TRACE(logger, "Saved replay '{}'.", file_path);
     });
@@ -8,6 +8,7 @@
 #include "sockpp/platform.h"
 
 #include <filesystem>
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -19,6 +20,8 @@ struct app_args final {
 
   std::filesystem::path replays_dir;
   size_t replays_count;
+
+  bool one_shot;
 };
 
 struct app_state final {
@@ -27,12 +30,15 @@ struct app_state final {
 
   std::vector<std::pair<uid_t, state>> states;
   std::vector<std::pair<uid_t, brain_t>> population;
+  // Range of states to run each individual at, when given.
+  std::vector<std::pair<size_t, size_t>> blocks;
 
   uint64_t check;
   size_t capacity_base;
   pb::outcomes req;
 
   std::unique_ptr<basic_replay_exporter> pexp;
+  std::unique_ptr<client::session> session;
 };
 
 class app final {
@@ -48,6 +54,8 @@ class app final {
 
   void do_simulation();
 
+  void send_heartbeat();
+
 public:
 
   app();
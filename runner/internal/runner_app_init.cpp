@@ -42,10 +42,15 @@ void app::do_init() {
     s.pexp = make_unique<basic_replay_exporter>();
   }
 
+  if (!s.session) {
+    s.session = make_unique<client::session>(
+      sockpp::inet_address{_args.host, _args.port}, _args.one_shot);
+  }
+
   SPDLOG_LOGGER_INFO(_logger, "Ready!", s.req.client_name());
 
   for(client::response r;;) {
-    try { r = client::request<pb::cases>({_args.host, _args.port}); }
+    try { r = s.session->request<pb::cases>(); }
     catch (std::exception &e) { CLIENT_LOOP_REP_(1, e.what()); }
 
     auto& cases = r.begin()->as<pb::cases>()->data();
@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <chrono>
+#include <exception>
 #include <iterator>
 #include <ostream>
 
@@ -49,13 +50,28 @@ double eval_outcome_rating(size_t steps, outcome o, const state& s,
   }
 }
 
+// Keeps the trainer's lease on a long job alive.
+constexpr inline auto heartbeat_interval = 3s;
+
 } // namespace
 
+void app::send_heartbeat() {
+  auto& s = state();
+
+  pb::heartbeat msg;
+  msg.set_client_name(s.req.client_name());
+  msg.set_generation(s.req.generation());
+  try { s.session->request(msg); }
+  catch (std::exception& e) {
+    SPDLOG_LOGGER_DEBUG(_logger, "Heartbeat failed: {}", e.what());
+  }
+}
+
 void app::do_simulation() {
   auto& s = state();
 
   for(client::response r;;) {
-    try { r = client::request({_args.host, _args.port}, s.req); }
+    try { r = s.session->request(s.req); }
     catch (std::logic_error& e) { CLIENT_LOOP_REP_(1, e.what()); }
     catch (io::transfer_error& e) {
       SPDLOG_LOGGER_WARN(_logger, "Simulation process interrupted: {}",
@@ -68,6 +84,7 @@ void app::do_simulation() {
     s.population.clear();
     s.req.clear_data();
     s.req.set_generation(population->generation());
+    s.req.set_fidelity(population->fidelity());
 
     auto& population_data = population->data();
     CLIENT_LOOP_REP_(population_data.empty(), "No population's been given.");
@@ -76,19 +93,30 @@ void app::do_simulation() {
     transform(population_data.begin(), population_data.end(),
       back_inserter(s.population), converter());
 
+    s.blocks.clear();
+    for (auto& b : population->blocks())
+      s.blocks.emplace_back(b.start(), b.count());
+
     SPDLOG_LOGGER_TRACE(_logger, "Received population of {} individuals.",
       s.population.size());
     break;
   }
 
   using clk_t = chrono::steady_clock;
-  auto start = clk_t::now();
+  auto start = clk_t::now(), last_beat = start;
+  size_t sim_count = 0;
+  bool coarse = s.req.fidelity() == pb::FIDELITY_COARSE;
   {
     auto outcomes = s.req.mutable_data();
     outcomes->Clear();
 
-    for (const auto& sp : s.population)
-    for (const auto& ss : s.states) {
+    for (size_t i = 0, imax = s.population.size(); i < imax; ++i)
+    for (size_t k = 0, kmax = i < s.blocks.size()
+        ? min(s.blocks[i].second, s.states.size()) : s.states.size();
+        k < kmax; ++k, ++sim_count) {
+      const auto& sp = s.population[i];
+      const auto& ss = i < s.blocks.size()
+        ? s.states[(s.blocks[i].first + k) % s.states.size()] : s.states[k];
       auto sim_state{ss.second};
       nn::game_adapter a(sp.second, ss.second, ss.second);
 
@@ -100,7 +128,9 @@ void app::do_simulation() {
       auto steps = steps_limit;
       auto o = outcome::Aerial;
       for (;o == outcome::Aerial & steps > 0; --steps) {
-        sim_state.out = a.get_output(sim_state);
+        // At coarse fidelity, the controls are held for two turns.
+        if (!coarse || (steps_limit - steps) % 2 == 0)
+          sim_state.out = a.get_output(sim_state);
         o = simulate(sim_state);
 
         s.pexp->push_turn(sim_state);
@@ -126,11 +156,16 @@ void app::do_simulation() {
 
       s.pexp->do_export(s.req.generation(),
         ss.first, sp.first, o);
+
+      if (clk_t::now() - last_beat >= heartbeat_interval) {
+        send_heartbeat();
+        last_beat = clk_t::now();
+      }
     }
   }
   auto duration = clk_t::now() - start;
-  SPDLOG_LOGGER_TRACE(_logger, "Processed {} individuals @ {} cases for {}.",
-    s.population.size(), s.states.size(), duration);
+  SPDLOG_LOGGER_TRACE(_logger, "Processed {} individuals, {} simulations for {}.",
+    s.population.size(), sim_count, duration);
 
   auto new_capacity = s.capacity_base * (300ms / duration);
   s.req.set_capacity(max(new_capacity, s.capacity_base));
@@ -58,6 +58,9 @@ void help(pcstr name) {
 "  --keep-replays=N           Keep N last successful landing replays.\n"
 "  --replays-dir=replays/dir  Replays directory path; PWD by default.\n"
 "\n"
+"  --one-shot                 Open a connection per request rather than\n"
+"                             keep one session with the trainer open.\n"
+"\n"
 "There is nowhere to file bugs.\n"
 "You're all alone, do not expect any help.\n";
 
@@ -72,18 +75,21 @@ void fill_defaults(runner::app_args& args) {
   args.port = default_port;
   args.replays_count = 0;
   args.replays_dir = "./";
+  args.one_shot = false;
 }
 
 void parse_options(int argc, const pstr* argv, runner::app_args& args) {
   int fake_flag;
   constexpr int keep_replays_ind = 3;
   constexpr int replays_dir_ind = 4;
+  constexpr int one_shot_ind = 5;
   struct option opts[] = {
     {"help", no_argument, nullptr, 0},
     {"host", required_argument, nullptr, 'h'},
     {"port", required_argument, nullptr, 'p'},
     {"keep-replays", optional_argument, &fake_flag, keep_replays_ind},
     {"replays-dir", required_argument, &fake_flag, replays_dir_ind},
+    {"one-shot", no_argument, &fake_flag, one_shot_ind},
     { NULL, 0, NULL, 0 }
   };
 
@@ -110,6 +116,10 @@ void parse_options(int argc, const pstr* argv, runner::app_args& args) {
             if (optarg) args.replays_dir = optarg;
             break;
           }
+          case one_shot_ind: {
+            args.one_shot = true;
+            break;
+          }
         }
         break;
       }
@@ -69,29 +69,4 @@ std::pair<uid_t, state> convert(const pb::landing_case&);
 
 } // namespace data
 
-#define PRETTY_JSON std::setw(2) << std::setfill(' ')
-#define JSON_SESSION_DUMP(check,generation,cases_count,population_size,\
-elite_count,tournament_size,crossover,mutation,cases,population)\
-nlohmann::json{\
-  {"check",check},\
-  {"generation",generation},\
-  {"cases_count",cases_count},\
-  {"population_size",population_size},\
-  {"elite_count",elite_count},\
-  {"tournament_size",tournament_size},\
-  {"crossover",crossover},\
-  {"mutation",mutation},\
-  {"cases",json_cases},\
-  {"population",json_population},\
-}
-#define JSON_REPLAY(case_id,gene_id,outcome,base64_state,surface,turns)\
-nlohmann::json{\
-  {"case_id",case_id},\
-  {"gene_id",gene_id},\
-  {"outcome",outcome},\
-  {"state",base64_state},\
-  {"surface",surface},\
-  {"turns",turns},\
-}
-
 } // namespace marslander
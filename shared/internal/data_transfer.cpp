@@ -1,5 +1,7 @@
 #include "data_transfer.h"
 
+#include <cstring>
+
 namespace marslander::io {
 
 namespace detail_ {
@@ -30,6 +32,29 @@ bool write_any(google::protobuf::io::CodedOutputStream* dst,
 
 } // namespace detail_
 
+namespace {
+
+void check_messages_count(uint32_t messages_count) {
+  using detail_::max_messages_count;
+  if (messages_count > max_messages_count) {
+    std::stringstream out("Data packet header specifies", std::ios_base::ate);
+    out << messages_count << " messages to read; "
+      << max_messages_count << " is the allowed maximum.";
+    throw transfer_error(out.str());
+  }
+}
+
+void read_messages(google::protobuf::io::CodedInputStream* cis,
+    sockpp::stream_socket& src, const pb::messages_factory_mapping& m,
+    google::protobuf::Arena* arena, std::vector<any_message>& msgs_out) {
+  for (auto& item : msgs_out) {
+    if (!detail_::read_any(cis, m, arena, item))
+      throw transfer_error(src);
+  }
+}
+
+} // namespace
+
 sockpp::stream_socket& read(sockpp::stream_socket& src,
     const pb::messages_factory_mapping& m, google::protobuf::Arena* arena,
     std::vector<any_message>& msgs_out) {
@@ -39,21 +64,86 @@ sockpp::stream_socket& read(sockpp::stream_socket& src,
   detail_::packet_header hdr{};
   cis.ReadRaw(static_cast<void*>(&hdr), sizeof(hdr));
 
-  constexpr size_t max_messages_count = 128;
-  if (hdr.messages_count > max_messages_count) {
-    std::stringstream out("Data packet header specifies", std::ios_base::ate);
-    out << hdr.messages_count << " messages to read; "
-      << max_messages_count << " is the allowed maximum.";
-    throw transfer_error(out.str());
+  check_messages_count(hdr.messages_count);
+  msgs_out.resize(hdr.messages_count);
+  read_messages(&cis, src, m, arena, msgs_out);
+
+  return src;
+}
+
+bool messages_size(const char* data, size_t size, uint32_t messages_count,
+    size_t& size_out) {
+  check_messages_count(messages_count);
+
+  size_t pos = 0;
+  for (uint32_t i = 0; i < messages_count; ++i) {
+    detail_::message_header hdr;
+    if (size - pos < sizeof(hdr)) return false;
+    memcpy(&hdr, data + pos, sizeof(hdr));
+    pos += sizeof(hdr);
+    if (hdr.message_size > detail_::max_payload_size)
+      throw transfer_error("Message is too large.");
+    if (size - pos < hdr.message_size) return false;
+    pos += hdr.message_size;
   }
 
-  msgs_out.resize(hdr.messages_count);
+  size_out = pos;
+  return true;
+}
+
+bool frame_size(const char* data, size_t size, uint32_t& request_id,
+    uint32_t& messages_count, size_t& payload_size_out) {
+  detail_::frame_header hdr;
+  if (size < sizeof(hdr)) return false;
+  memcpy(&hdr, data, sizeof(hdr));
+
+  check_messages_count(hdr.messages_count);
+  if (hdr.payload_size > detail_::max_payload_size)
+    throw transfer_error("Frame payload is too large.");
+  if (size - sizeof(hdr) < hdr.payload_size) return false;
+
+  request_id = hdr.request_id;
+  messages_count = hdr.messages_count;
+  payload_size_out = hdr.payload_size;
+  return true;
+}
+
+void parse(const char* data, size_t size, uint32_t messages_count,
+    const pb::messages_factory_mapping& m, google::protobuf::Arena* arena,
+    std::vector<any_message>& msgs_out) {
+  check_messages_count(messages_count);
+
+  google::protobuf::io::ArrayInputStream ais(data, int(size));
+  google::protobuf::io::CodedInputStream cis(&ais);
+
+  msgs_out.resize(messages_count);
   for (auto& item : msgs_out) {
     if (!detail_::read_any(&cis, m, arena, item))
-      throw transfer_error(src);
+      throw transfer_error("Malformed message.");
   }
+}
 
-  return src;
+bool read_frame(sockpp::stream_socket& src,
+    const pb::messages_factory_mapping& m, google::protobuf::Arena* arena,
+    uint32_t& request_id, std::vector<any_message>& msgs_out) {
+  detail_::frame_header hdr{};
+  auto n = src.read_n(&hdr, sizeof(hdr));
+  if (n == 0) return false;
+  if (n != ssize_t(sizeof(hdr))) throw transfer_error(src);
+
+  check_messages_count(hdr.messages_count);
+  if (hdr.payload_size > detail_::max_payload_size)
+    throw transfer_error("Frame payload is too large.");
+
+  std::string payload(hdr.payload_size, '\0');
+  if (src.read_n(payload.data(), payload.size()) != ssize_t(payload.size()))
+    throw transfer_error(src);
+
+  request_id = hdr.request_id;
+  parse(payload.data(), payload.size(), hdr.messages_count, m, arena,
+    msgs_out);
+
+  return true;
 }
 
 } // namespace marslander
@@ -121,8 +121,18 @@ public:
   int error_code() const noexcept { return _errc; }
 };
 
+// Sent in place of a packet header, opens a session: request and
+// response frames then go both ways over the connection for as long as
+// it lasts, each response carrying the id of its request, so they may
+// come in any order. A server echoes the marker to accept the session;
+// one that only serves one-shot requests refuses it as too many messages.
+inline constexpr uint32_t session_marker = ~uint32_t{};
+
 namespace detail_ {
 
+inline constexpr size_t max_messages_count = 128;
+inline constexpr uint64_t max_payload_size = 1ULL << 30;
+
 bool write_any(google::protobuf::io::CodedOutputStream* dst,
   const any_message& m);
 
@@ -130,6 +140,14 @@ struct packet_header final {
   uint32_t messages_count;
 };
 
+// The payload is read as a whole, so that nothing past the frame is
+// consumed from the connection.
+struct frame_header final {
+  uint32_t request_id;
+  uint32_t messages_count;
+  uint64_t payload_size;
+};
+
 struct identity_ final {
   template<typename V>
   V&& operator()(V&& v) { return std::forward<V>(v); }
@@ -151,12 +169,79 @@ auto& write_n(sockpp::stream_socket& dst, It from, uint32_t n,
   return dst;
 }
 
+// Serializes n messages after header_size bytes left for the header,
+// which is filled in once the size is known.
+template<typename It, typename Cvt = identity_>
+std::string encode_n(size_t header_size, It from, uint32_t n,
+    Cvt conv = Cvt()) {
+  std::string buf(header_size, '\0');
+  {
+    google::protobuf::io::StringOutputStream sos(&buf);
+    google::protobuf::io::CodedOutputStream cos(&sos);
+    for (auto i = n; i > 0; --i) {
+      if (!detail_::write_any(&cos, conv(*from++)))
+        throw transfer_error("Failed to serialize a message.");
+    }
+  }
+  return buf;
+}
+
+template<typename Header>
+void put_header(std::string& buf, const Header& hdr) {
+  buf.replace(0, sizeof(hdr), reinterpret_cast<const char*>(&hdr),
+    sizeof(hdr));
+}
+
+template<typename It, typename Cvt = identity_>
+std::string encode_frame_n(uint32_t request_id, It from, uint32_t n,
+    Cvt conv = Cvt()) {
+  auto frame = encode_n(sizeof(frame_header), from, n, conv);
+  put_header(frame, frame_header{request_id, n,
+    frame.size() - sizeof(frame_header)});
+  return frame;
+}
+
+template<typename It, typename Cvt = identity_>
+auto& write_frame_n(sockpp::stream_socket& dst, uint32_t request_id,
+    It from, uint32_t n, Cvt conv = Cvt()) {
+  // The frame goes out in one write.
+  auto frame = encode_frame_n(request_id, from, n, conv);
+  if (dst.write_n(frame.data(), frame.size()) != ssize_t(frame.size()))
+    throw transfer_error(dst);
+
+  return dst;
+}
+
 } // namespace detail_
 
 sockpp::stream_socket& read(sockpp::stream_socket& src,
   const pb::messages_factory_mapping& m, google::protobuf::Arena* arena,
   std::vector<any_message>& msgs_out);
 
+// Incremental decoding, for connections read as data comes: whether
+// `size` bytes at `data` hold all of `messages_count` messages of a
+// packet, and how many bytes they take if so.
+bool messages_size(const char* data, size_t size, uint32_t messages_count,
+  size_t& size_out);
+
+// Same for a frame of a session, which starts with a header of
+// frame_header_size bytes; the size is of its payload.
+bool frame_size(const char* data, size_t size, uint32_t& request_id,
+  uint32_t& messages_count, size_t& payload_size_out);
+
+inline constexpr size_t frame_header_size = sizeof(detail_::frame_header);
+
+// Parses messages out of a buffer holding all of them.
+void parse(const char* data, size_t size, uint32_t messages_count,
+  const pb::messages_factory_mapping& m, google::protobuf::Arena* arena,
+  std::vector<any_message>& msgs_out);
+
+// Reads a frame of a session; false when the connection has been closed
+// in between frames.
+bool read_frame(sockpp::stream_socket& src,
+  const pb::messages_factory_mapping& m, google::protobuf::Arena* arena,
+  uint32_t& request_id, std::vector<any_message>& msgs_out);
+
 template<typename... Ts,
 std::enable_if_t<
   std::conjunction_v<std::is_base_of<pb_msg_t, Ts>...>,
@@ -189,4 +274,52 @@ auto& write(sockpp::stream_socket& dst, const pb::packet_id_mapping& m,
     [&m](auto& v) { return any_message(v, m); });
 }
 
+// Packets and frames as bytes, for connections written as they become
+// ready.
+template<typename It,
+std::enable_if_t<
+  std::is_same_v<any_message,
+    std::remove_cv_t<typename std::iterator_traits<It>::value_type>>,
+  bool
+> = true>
+std::string encode(It from, It to) {
+  uint32_t n = std::distance(from, to);
+  auto packet = detail_::encode_n(sizeof(detail_::packet_header), from, n);
+  detail_::put_header(packet, detail_::packet_header{n});
+  return packet;
+}
+
+template<typename It,
+std::enable_if_t<
+  std::is_same_v<any_message,
+    std::remove_cv_t<typename std::iterator_traits<It>::value_type>>,
+  bool
+> = true>
+std::string encode_frame(uint32_t request_id, It from, It to) {
+  return detail_::encode_frame_n(request_id, from, std::distance(from, to));
+}
+
+template<typename... Ts,
+std::enable_if_t<
+  std::conjunction_v<std::is_base_of<pb_msg_t, Ts>...>,
+  bool
+> = true>
+auto& write_frame(sockpp::stream_socket& dst, uint32_t request_id,
+    const Ts&... msgs) {
+  auto l = { any_message(msgs)... };
+  return detail_::write_frame_n(dst, request_id, std::begin(l), l.size());
+}
+
+template<typename It,
+std::enable_if_t<
+  std::is_same_v<any_message,
+    std::remove_cv_t<typename std::iterator_traits<It>::value_type>>,
+  bool
+> = true>
+auto& write_frame(sockpp::stream_socket& dst, uint32_t request_id,
+    It from, It to) {
+  return detail_::write_frame_n(dst, request_id, from,
+    std::distance(from, to));
+}
+
 } // namespace marslander
@@ -0,0 +1,51 @@
+#include "json_stream.h"
+
+namespace marslander {
+
+using namespace std;
+
+void json_stream::separate() {
+  if (_after_key) {
+    _after_key = false;
+    return;
+  }
+  if (_nonempty.empty()) return;
+
+  if (_nonempty.back()) _os << ',';
+  _nonempty.back() = true;
+  if (_indent >= 0)
+    _os << '\n' << string(_nonempty.size() * _indent, ' ');
+}
+
+void json_stream::close(char bracket) {
+  bool nonempty = _nonempty.back();
+  _nonempty.pop_back();
+  if (nonempty && _indent >= 0)
+    _os << '\n' << string(_nonempty.size() * _indent, ' ');
+  _os << bracket;
+}
+
+json_stream& json_stream::key(string_view k) {
+  separate();
+  _os << nlohmann::json(string(k)).dump() << (_indent >= 0 ? ": " : ":");
+  _after_key = true;
+  return *this;
+}
+
+// Nested lines of a value are shifted to the depth it's written at.
+void json_stream::write_dump(const string& dump) {
+  if (_indent < 0 || _nonempty.empty()) {
+    _os << dump;
+    return;
+  }
+
+  string pad(_nonempty.size() * _indent, ' ');
+  size_t from = 0;
+  for (auto to = dump.find('\n'); to != string::npos;
+      from = to + 1, to = dump.find('\n', from)) {
+    _os.write(dump.data() + from, streamsize(to + 1 - from)) << pad;
+  }
+  _os.write(dump.data() + from, streamsize(dump.size() - from));
+}
+
+} // namespace marslander
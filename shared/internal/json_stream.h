@@ -0,0 +1,54 @@
+#include "nlohmann/json.hpp"
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace marslander {
+
+// Writes a JSON document piece by piece as it is produced, rather than
+// building it up in memory first; only single values go through
+// nlohmann::json. The layout matches json::dump with the same indent,
+// a negative one writing the document compactly.
+class json_stream final {
+
+  std::ostream& _os;
+  const int _indent;
+
+  // Whether each open container has any members yet.
+  std::vector<bool> _nonempty;
+  bool _after_key;
+
+  json_stream& open() { _nonempty.push_back(false); return *this; }
+  void separate();
+  void close(char bracket);
+  void write_dump(const std::string& dump);
+
+public:
+
+  explicit json_stream(std::ostream& os, int indent = -1)
+    : _os{os}, _indent{indent}, _after_key{} {}
+
+  json_stream& begin_object() { separate(); _os << '{'; return open(); }
+  json_stream& begin_array() { separate(); _os << '['; return open(); }
+  json_stream& end_object() { close('}'); return *this; }
+  json_stream& end_array() { close(']'); return *this; }
+
+  json_stream& key(std::string_view k);
+
+  template<typename T>
+  json_stream& value(const T& v) {
+    separate();
+    write_dump(nlohmann::json(v).dump(_indent));
+    return *this;
+  }
+
+  template<typename T>
+  json_stream& field(std::string_view k, const T& v) {
+    return key(k).value(v);
+  }
+
+};
+
+} // namespace marslander
@@ -42,6 +42,8 @@ MESSAGE_LITE_INFO_(type, message_id, type::GetDescriptor()->full_name())
 MESSAGE_INFO_(cases, 1);
 MESSAGE_INFO_(outcomes, 2);
 MESSAGE_INFO_(population, 3);
+MESSAGE_INFO_(migrants, 4);
+MESSAGE_INFO_(heartbeat, 5);
 // TODO: more types go here.
 
 typedef std::map<std::string, message_id_t> packet_id_mapping;
@@ -52,6 +54,8 @@ inline packet_id_mapping build_packet_id_mapping() {
     std_string_2_message_id_t_(cases),
     std_string_2_message_id_t_(outcomes),
     std_string_2_message_id_t_(population),
+    std_string_2_message_id_t_(migrants),
+    std_string_2_message_id_t_(heartbeat),
   };
 }
 
@@ -68,6 +72,8 @@ inline messages_factory_mapping build_messages_factory_mapping() {
     message_id_t_2_factory_func_(cases),
     message_id_t_2_factory_func_(outcomes),
     message_id_t_2_factory_func_(population),
+    message_id_t_2_factory_func_(migrants),
+    message_id_t_2_factory_func_(heartbeat),
   };
 }
 
@@ -14,6 +14,7 @@
 // Non-dependent headers
 #include "internal/chrono_insert_compat.h"
 #include "internal/floating_point.h"
+#include "internal/json_stream.h"
 #include "internal/landing_case_randomize.h"
 #include "internal/looper.h"
 #include "internal/nn_randomize.h"
@@ -1,7 +1,12 @@
 #include "crc32.h"
+#include "crc32_streambuf.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <iterator>
+#include <ostream>
+#include <sstream>
+#include <string>
 
 #include "gtest/gtest.h"
 namespace marslander::checksum {
@@ -140,4 +145,23 @@ TEST(CRC32Tests, LargeBufferMultipleUpdates) {
   ASSERT_EQ(expected, result);
 }
 
+TEST(CRC32Tests, StreambufPassesThrough) {
+  std::ostringstream dst;
+  crc32_streambuf sb(dst.rdbuf());
+  std::ostream os(&sb);
+
+  constexpr size_t chunk_sz = 100;
+  for (size_t i = 0; i < sizeof(buf_large_4k_); i += chunk_sz) {
+    os.write(&buf_large_4k_[i], std::min(chunk_sz, sizeof(buf_large_4k_) - i));
+    os.put('-');
+  }
+  os.flush();
+
+  auto written = dst.str();
+  const auto expected = crc32_ref(written.data(), uint32_t(written.size()));
+  ASSERT_EQ(expected, sb.checksum());
+  ASSERT_EQ(sizeof(buf_large_4k_) + (sizeof(buf_large_4k_) + chunk_sz - 1)
+    / chunk_sz, written.size());
+}
+
 } // namespace marslander::checksum
@@ -0,0 +1,143 @@
+#include "shared.h"
+
+#include <sys/socket.h>
+
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+namespace {
+
+using namespace marslander;
+using namespace std;
+
+const auto factory = pb::build_messages_factory_mapping();
+
+pair<sockpp::stream_socket, sockpp::stream_socket> connected_pair() {
+  int fds[2];
+  EXPECT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  return { sockpp::stream_socket(fds[0]), sockpp::stream_socket(fds[1]) };
+}
+
+pb::heartbeat make_heartbeat() {
+  pb::heartbeat hb;
+  hb.set_client_name("runner-1");
+  hb.set_generation(42);
+  return hb;
+}
+
+pb::population make_population() {
+  pb::population p;
+  p.set_generation(42);
+  for (int i = 0; i < 3; ++i) {
+    auto g = p.add_data();
+    g->set_id(100 + i);
+    g->add_genes(.5 * i);
+  }
+  return p;
+}
+
+void expect_messages(const vector<io::any_message>& msgs,
+    const pb::heartbeat& hb, const pb::population& p) {
+  ASSERT_EQ(msgs.size(), 2);
+  ASSERT_EQ(msgs[0].id, pb::message_info<pb::heartbeat>::message_id);
+  ASSERT_EQ(msgs[1].id, pb::message_info<pb::population>::message_id);
+  EXPECT_EQ(msgs[0].as<pb::heartbeat>()->SerializeAsString(),
+    hb.SerializeAsString());
+  EXPECT_EQ(msgs[1].as<pb::population>()->SerializeAsString(),
+    p.SerializeAsString());
+}
+
+TEST(SharedTests, session_frames_round_trip) {
+
+  auto [client, server] = connected_pair();
+  auto hb = make_heartbeat();
+  auto p = make_population();
+  io::write_frame(client, 7, hb, p);
+  vector<io::any_message> none;
+  io::write_frame(client, 9, none.begin(), none.end());
+  client.close();
+
+  google::protobuf::Arena arena;
+  uint32_t request_id;
+  vector<io::any_message> msgs;
+  ASSERT_TRUE(io::read_frame(server, factory, &arena, request_id, msgs));
+  EXPECT_EQ(request_id, 7);
+  expect_messages(msgs, hb, p);
+
+  // Nothing past a frame is consumed, so the next one reads whole.
+  ASSERT_TRUE(io::read_frame(server, factory, &arena, request_id, msgs));
+  EXPECT_EQ(request_id, 9);
+  EXPECT_TRUE(msgs.empty());
+
+  EXPECT_FALSE(io::read_frame(server, factory, &arena, request_id, msgs));
+}
+
+TEST(SharedTests, session_frames_decode_incrementally) {
+
+  auto hb = make_heartbeat();
+  auto p = make_population();
+  vector<io::any_message> l{ hb, p };
+  auto frame = io::encode_frame(3, l.begin(), l.end());
+
+  uint32_t request_id, messages_count;
+  size_t payload_size;
+  for (size_t k = 0; k < frame.size(); ++k)
+    EXPECT_FALSE(io::frame_size(frame.data(), k, request_id,
+      messages_count, payload_size)) << "at " << k;
+  ASSERT_TRUE(io::frame_size(frame.data(), frame.size(), request_id,
+    messages_count, payload_size));
+  EXPECT_EQ(request_id, 3);
+  EXPECT_EQ(io::frame_header_size + payload_size, frame.size());
+
+  google::protobuf::Arena arena;
+  vector<io::any_message> msgs;
+  io::parse(frame.data() + io::frame_header_size, payload_size,
+    messages_count, factory, &arena, msgs);
+  expect_messages(msgs, hb, p);
+}
+
+TEST(SharedTests, one_shot_packets_round_trip) {
+
+  auto [client, server] = connected_pair();
+  auto hb = make_heartbeat();
+  auto p = make_population();
+  io::write(client, hb, p);
+
+  google::protobuf::Arena arena;
+  vector<io::any_message> msgs;
+  io::read(server, factory, &arena, msgs);
+  expect_messages(msgs, hb, p);
+
+  vector<io::any_message> l{ hb, p };
+  auto packet = io::encode(l.begin(), l.end());
+  uint32_t messages_count;
+  memcpy(&messages_count, packet.data(), sizeof(messages_count));
+  EXPECT_EQ(messages_count, 2);
+  size_t size;
+  ASSERT_TRUE(io::messages_size(packet.data() + sizeof(messages_count),
+    packet.size() - sizeof(messages_count), messages_count, size));
+  EXPECT_EQ(sizeof(messages_count) + size, packet.size());
+}
+
+// A server of one-shot requests reads the marker as a messages count,
+// and refuses it; clients fall back to a connection per request then.
+TEST(SharedTests, one_shot_servers_refuse_sessions) {
+
+  auto [client, server] = connected_pair();
+  auto marker = io::session_marker;
+  ASSERT_EQ(client.write_n(&marker, sizeof(marker)),
+    ssize_t(sizeof(marker)));
+
+  google::protobuf::Arena arena;
+  vector<io::any_message> msgs;
+  EXPECT_THROW(io::read(server, factory, &arena, msgs), io::transfer_error);
+
+  size_t size;
+  EXPECT_THROW(io::messages_size(nullptr, 0, io::session_marker, size),
+    io::transfer_error);
+}
+
+} // namespace
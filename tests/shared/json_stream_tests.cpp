@@ -0,0 +1,39 @@
+#include "shared.h"
+
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+namespace {
+
+using namespace marslander;
+using namespace std;
+
+void write_document(json_stream& js) {
+  js.begin_object()
+    .key("cases").begin_array();
+  for (int i = 0; i < 2; ++i)
+    js.value(nlohmann::json{{"id", i}, {"xs", {1, 2, {{"y", i}}}}});
+  js.end_array()
+    .field("check", 5)
+    .key("empty").begin_array().end_array()
+    .key("population").begin_array()
+      .begin_object().field("name", "\"quoted\"").end_object()
+    .end_array()
+  .end_object();
+}
+
+TEST(SharedTests, json_stream_matches_dump) {
+
+  for (int indent : {-1, 0, 2, 4}) {
+    ostringstream os;
+    json_stream js(os, indent);
+    write_document(js);
+
+    auto j = nlohmann::json::parse(os.str());
+    ASSERT_EQ(j.dump(indent), os.str()) << "indent " << indent;
+  }
+
+}
+
+} // namespace
@@ -0,0 +1,107 @@
+#include "internal/fitness_cache.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+namespace {
+
+using namespace marslander;
+using namespace marslander::trainer;
+using namespace std;
+
+pb::genome make_genome(const vector<double>& genes) {
+  pb::genome g;
+  for (auto v : genes) g.add_genes(v);
+  return g;
+}
+
+void insert(fitness_cache& c, const pb::genome& g,
+    const vector<double>& ratings) {
+  c.insert(fitness_cache::hash(g), g, ratings.begin(), ratings.end());
+}
+
+const fitness_cache::ratings_type* find(fitness_cache& c,
+    const pb::genome& g) {
+  return c.find(fitness_cache::hash(g), g);
+}
+
+TEST(TrainerTests, fitness_cache_finds_equal_genes) {
+
+  fitness_cache c(4);
+  auto g = make_genome({ 1., -2., .5 });
+  insert(c, g, { 3., 4. });
+
+  auto ratings = find(c, make_genome({ 1., -2., .5 }));
+  ASSERT_NE(ratings, nullptr);
+  EXPECT_EQ(*ratings, (vector<double>{ 3., 4. }));
+  EXPECT_EQ(find(c, make_genome({ 1., -2. })), nullptr);
+  EXPECT_EQ(find(c, make_genome({ 1., -2., .25 })), nullptr);
+}
+
+TEST(TrainerTests, fitness_cache_evicts_the_least_recently_used) {
+
+  fitness_cache c(2);
+  auto a = make_genome({ 1. }), b = make_genome({ 2. }),
+    d = make_genome({ 3. });
+  insert(c, a, { 1. });
+  insert(c, b, { 2. });
+
+  // A lookup makes a the most recent, so b goes first.
+  ASSERT_NE(find(c, a), nullptr);
+  insert(c, d, { 3. });
+  EXPECT_EQ(c.size(), 2);
+  EXPECT_NE(find(c, a), nullptr);
+  EXPECT_EQ(find(c, b), nullptr);
+  EXPECT_NE(find(c, d), nullptr);
+
+  // Re-inserting refreshes an entry as well.
+  insert(c, a, { 4. });
+  insert(c, b, { 2. });
+  EXPECT_EQ(find(c, d), nullptr);
+  ASSERT_NE(find(c, a), nullptr);
+  EXPECT_EQ(*find(c, a), vector<double>{ 4. });
+}
+
+TEST(TrainerTests, fitness_cache_shrinks_to_its_capacity) {
+
+  fitness_cache c(3);
+  vector<pb::genome> genomes;
+  for (double v : { 1., 2., 3. }) {
+    genomes.push_back(make_genome({ v }));
+    insert(c, genomes.back(), { v });
+  }
+
+  c.resize(1);
+  EXPECT_EQ(c.size(), 1);
+  EXPECT_NE(find(c, genomes[2]), nullptr);
+  EXPECT_EQ(find(c, genomes[0]), nullptr);
+
+  c.resize(0);
+  EXPECT_EQ(c.size(), 0);
+  insert(c, genomes[0], { 1. });
+  EXPECT_EQ(c.size(), 0);
+  EXPECT_EQ(find(c, genomes[0]), nullptr);
+}
+
+TEST(TrainerTests, fitness_cache_misses_on_a_hash_collision) {
+
+  fitness_cache c(4);
+  auto a = make_genome({ 1., 2. }), b = make_genome({ 2., 1. });
+  constexpr fitness_cache::key_type key = 42;
+  vector<double> ratings{ 1. };
+  c.insert(key, a, ratings.begin(), ratings.end());
+
+  // Same key, other genes: no rating is handed out for them.
+  EXPECT_EQ(c.find(key, b), nullptr);
+  ASSERT_NE(c.find(key, a), nullptr);
+
+  // Inserting them takes the slot over.
+  ratings = { 5. };
+  c.insert(key, b, ratings.begin(), ratings.end());
+  EXPECT_EQ(c.size(), 1);
+  EXPECT_EQ(c.find(key, a), nullptr);
+  ASSERT_NE(c.find(key, b), nullptr);
+  EXPECT_EQ(*c.find(key, b), ratings);
+}
+
+} // namespace
@@ -0,0 +1,95 @@
+// The trainer is an executable, so the code under test is built in here.
+#include "internal/history.cpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "gtest/gtest.h"
+namespace {
+
+using namespace marslander::trainer;
+using namespace std;
+
+struct history_file final {
+  filesystem::path path = filesystem::temp_directory_path()
+    / ("history_tests." + to_string(
+        ::testing::UnitTest::GetInstance()->random_seed()) + ".bin");
+
+  history_file() { filesystem::remove(path); }
+  ~history_file() { filesystem::remove(path); }
+};
+
+generation_history make_generation(size_t generation) {
+  generation_history h;
+  h.generation = generation;
+  for (size_t i = 0; i < 5; ++i) {
+    h.scores.push_back(0.25 * double(i) + double(generation));
+    h.ids.push_back(100 * generation + i);
+  }
+  h.landing_rates = { 0.5, 1., 0. };
+  h.elite_ids = { 100 * generation + 3 };
+  return h;
+}
+
+void expect_equal(const generation_history& a, const generation_history& b) {
+  EXPECT_EQ(a.generation, b.generation);
+  EXPECT_EQ(a.scores, b.scores);
+  EXPECT_EQ(a.ids, b.ids);
+  EXPECT_EQ(a.landing_rates, b.landing_rates);
+  EXPECT_EQ(a.elite_ids, b.elite_ids);
+}
+
+TEST(TrainerTests, history_reads_generations_back) {
+
+  history_file file;
+  for (size_t g = 1; g <= 3; ++g)
+    ASSERT_TRUE(history::append(file.path, make_generation(g)));
+
+  vector<generation_history> read;
+  ASSERT_TRUE(history::read(file.path, read));
+  ASSERT_EQ(read.size(), 3);
+  for (size_t g = 1; g <= 3; ++g) expect_equal(read[g - 1], make_generation(g));
+}
+
+TEST(TrainerTests, history_columns_are_little_endian) {
+
+  history_file file;
+  ASSERT_TRUE(history::append(file.path, make_generation(0x0102)));
+
+  ifstream f(file.path, ios_base::binary);
+  vector<unsigned char> bytes{istreambuf_iterator<char>(f), {}};
+  ASSERT_GE(bytes.size(), 4 * sizeof(uint64_t));
+
+  auto u64_at = [&bytes](size_t i) {
+    uint64_t value = 0;
+    for (size_t b = 8; b-- > 0; )
+      value = value << 8 | bytes[i * sizeof(uint64_t) + b];
+    return value;
+  };
+  EXPECT_EQ(u64_at(0), 0x0102);
+  EXPECT_EQ(u64_at(1), 5);
+  EXPECT_EQ(u64_at(2), 3);
+  EXPECT_EQ(u64_at(3), 1);
+  // ids follow the 4 header words and the 5 scores
+  EXPECT_EQ(u64_at(9), 0x0102 * 100);
+}
+
+TEST(TrainerTests, history_recovers_from_a_cut_footer) {
+
+  history_file file;
+  ASSERT_TRUE(history::append(file.path, make_generation(1)));
+  ASSERT_TRUE(history::append(file.path, make_generation(2)));
+  filesystem::resize_file(file.path,
+    filesystem::file_size(file.path) - sizeof(uint64_t));
+  ASSERT_TRUE(history::append(file.path, make_generation(3)));
+
+  vector<generation_history> read;
+  ASSERT_TRUE(history::read(file.path, read));
+  ASSERT_EQ(read.size(), 3);
+  for (size_t g = 1; g <= 3; ++g) expect_equal(read[g - 1], make_generation(g));
+}
+
+} // namespace
@@ -0,0 +1,134 @@
+#include "internal/id_directory.h"
+
+#include <cstdint>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+namespace {
+
+using namespace marslander::trainer;
+using namespace std;
+
+struct item final {
+  uid_t value;
+  uid_t id() const { return value; }
+};
+
+vector<item> make_items(const vector<uid_t>& ids) {
+  vector<item> items;
+  for (auto id : ids) items.push_back({id});
+  return items;
+}
+
+void expect_positions(const id_directory& d, const vector<item>& items) {
+  for (size_t i = 0; i < items.size(); ++i)
+    EXPECT_EQ(d.find(items[i].id()), i) << "id " << items[i].id();
+}
+
+TEST(TrainerTests, id_directory_finds_a_dense_range) {
+
+  auto items = make_items({ 107, 100, 103, 101, 109 });
+  id_directory d;
+  d.rebuild(items.begin(), items.end());
+
+  EXPECT_EQ(d.size(), items.size());
+  expect_positions(d, items);
+  EXPECT_EQ(d.find(99), id_directory::npos);
+  EXPECT_EQ(d.find(102), id_directory::npos);
+  EXPECT_EQ(d.find(110), id_directory::npos);
+}
+
+TEST(TrainerTests, id_directory_hashes_a_sparse_range) {
+
+  auto items = make_items({ 5, 1'000'000, 1, 70'000, 3 });
+  id_directory d;
+  d.rebuild(items.begin(), items.end());
+
+  EXPECT_EQ(d.size(), items.size());
+  expect_positions(d, items);
+  EXPECT_EQ(d.find(2), id_directory::npos);
+  EXPECT_EQ(d.find(999'999), id_directory::npos);
+}
+
+TEST(TrainerTests, id_directory_turns_sparse_on_insert_out_of_range) {
+
+  auto items = make_items({ 10, 11, 12, 13 });
+  id_directory d;
+  d.rebuild(items.begin(), items.end());
+
+  items.push_back({ 5'000'000 });
+  d.insert(items.back().id(), id_directory::pos_type(items.size() - 1));
+  items.push_back({ 14 });
+  d.insert(items.back().id(), id_directory::pos_type(items.size() - 1));
+
+  EXPECT_EQ(d.size(), items.size());
+  expect_positions(d, items);
+  EXPECT_EQ(d.find(9), id_directory::npos);
+}
+
+TEST(TrainerTests, id_directory_forgets_ids_of_a_previous_rebuild) {
+
+  auto first = make_items({ 10, 11, 12, 13, 14, 15, 16, 17, 18, 19 });
+  auto second = make_items({ 15, 12, 14, 13 });
+  id_directory d;
+  d.rebuild(first.begin(), first.end());
+  d.rebuild(second.begin(), second.end());
+
+  EXPECT_EQ(d.size(), second.size());
+  expect_positions(d, second);
+  EXPECT_EQ(d.find(10), id_directory::npos);
+  EXPECT_EQ(d.find(19), id_directory::npos);
+
+  auto sparse = make_items({ 1, 100'000, 200'000 });
+  d.rebuild(sparse.begin(), sparse.end());
+  d.rebuild(second.begin(), second.end());
+  expect_positions(d, second);
+  EXPECT_EQ(d.find(100'000), id_directory::npos);
+}
+
+TEST(TrainerTests, id_directory_erases_without_breaking_probes) {
+
+  mt19937_64 rng(::testing::UnitTest::GetInstance()->random_seed());
+  uniform_int_distribution<uid_t> dist(1, 1'000'000'000);
+  set<uid_t> unique;
+  while (unique.size() < 500) unique.insert(dist(rng));
+
+  vector<item> items;
+  for (auto id : unique) items.push_back({id});
+  shuffle(items.begin(), items.end(), rng);
+
+  id_directory d;
+  d.rebuild(items.begin(), items.end());
+  ASSERT_EQ(d.size(), items.size());
+
+  for (size_t i = 0; i < items.size(); i += 2) d.erase(items[i].id());
+  d.erase(0);
+
+  EXPECT_EQ(d.size(), items.size() / 2);
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (i % 2 == 0) EXPECT_EQ(d.find(items[i].id()), id_directory::npos);
+    else EXPECT_EQ(d.find(items[i].id()), i);
+  }
+}
+
+TEST(TrainerTests, id_directory_erases_in_a_dense_range) {
+
+  auto items = make_items({ 20, 21, 22, 23 });
+  id_directory d;
+  d.rebuild(items.begin(), items.end());
+
+  d.erase(21);
+  d.erase(21);
+  d.erase(1'000);
+  EXPECT_EQ(d.size(), 3);
+  EXPECT_EQ(d.find(21), id_directory::npos);
+  EXPECT_EQ(d.find(22), 2);
+
+  d.insert(21, 7);
+  EXPECT_EQ(d.size(), 4);
+  EXPECT_EQ(d.find(21), 7);
+}
+
+} // namespace
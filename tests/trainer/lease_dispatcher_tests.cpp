@@ -0,0 +1,147 @@
+#include "internal/lease_dispatcher.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+namespace {
+
+using namespace marslander::trainer;
+using namespace std;
+using namespace std::chrono_literals;
+
+const auto t0 = lease_dispatcher::time_point{} + 1h;
+
+vector<size_t> lease(lease_dispatcher& d, const string& name,
+    lease_dispatcher::time_point now, size_t count) {
+  vector<size_t> leased;
+  d.lease(name, now, count, [&leased](auto i) { leased.push_back(i); });
+  return leased;
+}
+
+vector<size_t> unfinished(const lease_dispatcher& d) {
+  vector<size_t> r;
+  d.for_each_unfinished([&r](auto i) { r.push_back(i); return true; });
+  return r;
+}
+
+TEST(TrainerTests, lease_dispatcher_leases_ready_items_in_order) {
+
+  lease_dispatcher d;
+  d.reset(5);
+
+  EXPECT_EQ(lease(d, "a", t0, 2), (vector<size_t>{ 0, 1 }));
+  EXPECT_EQ(lease(d, "b", t0, 10), (vector<size_t>{ 2, 3, 4 }));
+  EXPECT_TRUE(lease(d, "c", t0, 10).empty());
+
+  EXPECT_TRUE(d.leased_to(1, "a"));
+  EXPECT_FALSE(d.leased_to(1, "b"));
+  EXPECT_FALSE(d.leased_to(1, "z"));
+  EXPECT_EQ(d.unfinished(), 5);
+}
+
+TEST(TrainerTests, lease_dispatcher_requeues_expired_leases) {
+
+  lease_dispatcher d;
+  d.reset(3);
+  ASSERT_EQ(lease(d, "a", t0, 2).size(), 2);
+
+  auto deadline = t0 + lease_dispatcher::default_lease;
+  EXPECT_EQ(lease(d, "b", deadline - 1s, 10), (vector<size_t>{ 2 }));
+  EXPECT_EQ(lease(d, "b", deadline, 10), (vector<size_t>{ 0, 1 }));
+  EXPECT_TRUE(d.leased_to(0, "b"));
+}
+
+TEST(TrainerTests, lease_dispatcher_extends_leases_on_heartbeat) {
+
+  lease_dispatcher d;
+  d.reset(2);
+  ASSERT_EQ(lease(d, "a", t0, 2).size(), 2);
+
+  auto deadline = t0 + lease_dispatcher::default_lease;
+  // Far from the deadline, a heartbeat doesn't shorten the lease.
+  d.heartbeat("a", t0);
+  auto late = deadline - 5s;
+  d.heartbeat("a", late);
+  d.heartbeat("b", late);
+
+  EXPECT_TRUE(lease(d, "b", deadline, 10).empty());
+  auto extended = late + lease_dispatcher::heartbeat_lease;
+  EXPECT_TRUE(lease(d, "b", extended - 1s, 10).empty());
+  EXPECT_EQ(lease(d, "b", extended, 10), (vector<size_t>{ 0, 1 }));
+}
+
+TEST(TrainerTests, lease_dispatcher_sizes_leases_after_throughput) {
+
+  lease_dispatcher d;
+  d.reset(6);
+  ASSERT_EQ(lease(d, "a", t0, 4).size(), 4);
+  EXPECT_EQ(d.simulation_time(), lease_dispatcher::duration::zero());
+
+  auto t1 = t0 + 4s;
+  d.report("a", t1, 8);
+  EXPECT_EQ(d.simulation_time(), lease_dispatcher::duration(500ms));
+  for (size_t i = 0; i < 4; ++i) d.complete(i);
+
+  // 1s per item measured, so two items are given three times as long.
+  ASSERT_EQ(lease(d, "a", t1, 2), (vector<size_t>{ 4, 5 }));
+  EXPECT_TRUE(lease(d, "b", t1 + 6s - 1ms, 10).empty());
+  EXPECT_EQ(lease(d, "b", t1 + 6s, 10), (vector<size_t>{ 4, 5 }));
+}
+
+TEST(TrainerTests, lease_dispatcher_sizes_leases_after_live_ready_items) {
+
+  lease_dispatcher d;
+  d.reset(4);
+  ASSERT_EQ(lease(d, "a", t0, 4).size(), 4);
+  auto t1 = t0 + 4s;
+  d.report("a", t1, 4);
+
+  // Culled items leave stale entries behind in the queue; they don't
+  // count towards the lease length.
+  d.reset(20);
+  for (size_t i = 0; i < 18; ++i) d.complete(i);
+  EXPECT_EQ(d.ready(), 2);
+  ASSERT_EQ(lease(d, "a", t1, 20), (vector<size_t>{ 18, 19 }));
+  EXPECT_EQ(d.ready(), 0);
+  EXPECT_TRUE(lease(d, "b", t1 + 6s - 1ms, 10).empty());
+  EXPECT_EQ(lease(d, "b", t1 + 6s, 10), (vector<size_t>{ 18, 19 }));
+}
+
+TEST(TrainerTests, lease_dispatcher_accounts_unfinished_items) {
+
+  lease_dispatcher d;
+  d.reset(4);
+  ASSERT_EQ(lease(d, "a", t0, 4).size(), 4);
+
+  d.complete(1);
+  d.complete(1);
+  d.complete(3);
+  EXPECT_EQ(d.unfinished(), 2);
+  EXPECT_TRUE(d.done(1));
+  EXPECT_EQ(unfinished(d), (vector<size_t>{ 0, 2 }));
+
+  // Completed items stay done past their deadlines.
+  auto deadline = t0 + lease_dispatcher::default_lease;
+  EXPECT_EQ(lease(d, "b", deadline, 10), (vector<size_t>{ 0, 2 }));
+  EXPECT_EQ(d.unfinished(), 2);
+
+  d.make_ready(3);
+  EXPECT_EQ(d.unfinished(), 3);
+  EXPECT_EQ(d.ready(), 1);
+  EXPECT_FALSE(d.done(3));
+  EXPECT_EQ(lease(d, "c", deadline, 10), (vector<size_t>{ 3 }));
+
+  d.complete(0);
+  d.complete(2);
+  d.complete(3);
+  EXPECT_EQ(d.unfinished(), 0);
+  EXPECT_TRUE(unfinished(d).empty());
+
+  d.reset(2);
+  EXPECT_EQ(d.unfinished(), 2);
+  EXPECT_EQ(unfinished(d), (vector<size_t>{ 0, 1 }));
+}
+
+} // namespace
@@ -0,0 +1,126 @@
+#include "internal/ga.h"
+#include "internal/optimizer.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+namespace {
+
+using namespace marslander;
+using namespace marslander::trainer;
+using namespace std;
+
+using cma_es = algo::opt::cma_es<mt19937_64>;
+
+constexpr size_t dims = 5, lambda = 12;
+
+auto make_rng(size_t salt = 0) {
+  return make_shared<mt19937_64>(
+    ::testing::UnitTest::GetInstance()->random_seed() + salt);
+}
+
+optimizer_algo::population_t make_population(mt19937_64& rng) {
+  uniform_real_distribution<> d(-1., 1.);
+  optimizer_algo::population_t p(lambda);
+  for (auto& g : p)
+    for (size_t i = 0; i < dims; ++i) g.add_genes(d(rng));
+  return p;
+}
+
+// An ill-conditioned quadratic with its minimum at (1, 2, 3, ...), the
+// coordinates coupled pairwise.
+double quadratic(const pb::genome& g) {
+  double r = 0.;
+  for (size_t i = 0; i < dims; ++i) {
+    auto x = g.genes(int(i)) - double(i + 1);
+    auto y = i + 1 < dims ? g.genes(int(i + 1)) - double(i + 2) : 0.;
+    r += double(1 << i) * x * x + .5 * x * y;
+  }
+  return r;
+}
+
+optimizer_algo::scores_t rate(const optimizer_algo::population_t& p) {
+  optimizer_algo::scores_t scores;
+  for (auto& g : p) scores.push_back(quadratic(g));
+  return scores;
+}
+
+double best(const optimizer_algo::scores_t& scores) {
+  return *min_element(scores.begin(), scores.end());
+}
+
+void expect_minimized(bool separable) {
+  auto rng = make_rng();
+  cma_es opt(rng, .5, separable);
+  auto p = make_population(*rng);
+  auto initial = best(rate(p));
+
+  for (int g = 0; g < 300; ++g) opt.exec(rate(p), p);
+  EXPECT_LT(best(rate(p)), 1e-6 * initial);
+  for (size_t i = 0; i < dims; ++i)
+    EXPECT_NEAR(p.front().genes(int(i)), double(i + 1), 1e-2);
+}
+
+TEST(TrainerTests, cma_es_minimizes_a_quadratic) {
+  expect_minimized(false);
+}
+
+TEST(TrainerTests, separable_cma_es_minimizes_a_quadratic) {
+  expect_minimized(true);
+}
+
+void expect_state_round_trip(bool separable) {
+  auto rng = make_rng();
+  cma_es opt(rng, 0., separable);
+  EXPECT_TRUE(opt.save().empty());
+
+  auto p = make_population(*rng);
+  for (int g = 0; g < 3; ++g) opt.exec(rate(p), p);
+  auto saved = opt.save();
+  ASSERT_EQ(saved.size(), 3 + 3 * dims + (separable ? dims : dims * dims));
+
+  cma_es restored(make_rng(), 0., separable);
+  ASSERT_TRUE(restored.load(saved));
+  EXPECT_EQ(restored.save(), saved);
+
+  // Both go on with the same distribution, so equal draws give equal
+  // offspring.
+  auto scores = rate(p);
+  auto q = p;
+  *rng = mt19937_64(7);
+  cma_es resumed(make_shared<mt19937_64>(7), 0., separable);
+  ASSERT_TRUE(resumed.load(saved));
+  opt.exec(scores, p);
+  resumed.exec(scores, q);
+  for (size_t k = 0; k < lambda; ++k)
+  for (size_t i = 0; i < dims; ++i)
+    EXPECT_DOUBLE_EQ(p[k].genes(int(i)), q[k].genes(int(i)));
+  EXPECT_EQ(opt.save(), resumed.save());
+}
+
+TEST(TrainerTests, cma_es_state_round_trips) {
+  expect_state_round_trip(false);
+}
+
+TEST(TrainerTests, separable_cma_es_state_round_trips) {
+  expect_state_round_trip(true);
+}
+
+TEST(TrainerTests, cma_es_rejects_a_state_of_the_other_variant) {
+
+  auto rng = make_rng();
+  cma_es sep(rng, 0., true);
+  auto p = make_population(*rng);
+  sep.exec(rate(p), p);
+
+  cma_es full(rng, 0., false);
+  EXPECT_FALSE(full.load(sep.save()));
+  EXPECT_FALSE(full.load({ 1., 2. }));
+  EXPECT_TRUE(full.load({}));
+  EXPECT_TRUE(full.save().empty());
+}
+
+} // namespace
@@ -0,0 +1,124 @@
+#include "internal/ga.h"
+#include "internal/selection.h"
+
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+namespace {
+
+using namespace marslander::trainer;
+using namespace std;
+
+constexpr size_t draws = 200'000;
+constexpr double tolerance = 0.01;
+
+auto make_rng() {
+  return make_shared<mt19937_64>(
+    ::testing::UnitTest::GetInstance()->random_seed());
+}
+
+template<class F>
+vector<double> frequencies(size_t n, F&& draw) {
+  vector<double> f(n);
+  for (size_t k = 0; k < draws; ++k) {
+    auto i = draw();
+    EXPECT_LT(i, n);
+    if (i < n) f[i] += 1. / draws;
+  }
+  return f;
+}
+
+void expect_distribution(const vector<double>& actual,
+    vector<double> expected) {
+  double sum = 0;
+  for (auto v : expected) sum += v;
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); ++i)
+    EXPECT_NEAR(actual[i], expected[i] / sum, tolerance) << "at " << i;
+}
+
+TEST(TrainerTests, alias_table_samples_proportionally_to_weights) {
+
+  vector<double> weights{ 1, 2, 0, 3, 4, 0.5 };
+  detail_::alias_table table;
+  table.build(weights.begin(), weights.end());
+  ASSERT_EQ(table.size(), weights.size());
+
+  auto rng = make_rng();
+  auto f = frequencies(weights.size(), [&]() { return table(*rng); });
+  expect_distribution(f, weights);
+  EXPECT_EQ(f[2], 0.);
+}
+
+TEST(TrainerTests, alias_table_falls_back_to_uniform) {
+
+  auto rng = make_rng();
+  for (auto weights : { vector<double>{ 0, 0, 0, 0 },
+      vector<double>{ 1, numeric_limits<double>::infinity(), 1, 1 } }) {
+    detail_::alias_table table;
+    table.build(weights.begin(), weights.end());
+    auto f = frequencies(weights.size(), [&]() { return table(*rng); });
+    expect_distribution(f, { 1, 1, 1, 1 });
+  }
+
+  vector<double> single{ 5 };
+  detail_::alias_table table;
+  table.build(single.begin(), single.end());
+  for (size_t k = 0; k < 100; ++k) EXPECT_EQ(table(*rng), 0);
+}
+
+TEST(TrainerTests, linear_rank_selection_follows_ranks) {
+
+  auto rng = make_rng();
+  algo::sel::linear_rank<mt19937_64> sel(rng, 2.);
+  EXPECT_TRUE(sel.meta().ranked);
+  sel.prepare({ 1, 2, 3, 4 });
+
+  auto f = frequencies(4, [&]() { return sel.exec(); });
+  expect_distribution(f, { 3, 2, 1, 0 });
+
+  algo::sel::linear_rank<mt19937_64> flat(rng, 1.);
+  flat.prepare({ 1, 2, 3, 4 });
+  expect_distribution(frequencies(4, [&]() { return flat.exec(); }),
+    { 1, 1, 1, 1 });
+}
+
+TEST(TrainerTests, exponential_rank_selection_follows_ranks) {
+
+  auto rng = make_rng();
+  algo::sel::exponential_rank<mt19937_64> sel(rng, .5);
+  EXPECT_TRUE(sel.meta().ranked);
+  sel.prepare({ 1, 2, 3, 4 });
+
+  auto f = frequencies(4, [&]() { return sel.exec(); });
+  expect_distribution(f, { 8, 4, 2, 1 });
+}
+
+TEST(TrainerTests, proportional_selection_follows_scores) {
+
+  auto rng = make_rng();
+  algo::sel::proportional<mt19937_64> sel(rng);
+  EXPECT_FALSE(sel.meta().ranked);
+  sel.prepare({ 3, 1, 5, 2 });
+
+  auto f = frequencies(4, [&]() { return sel.exec(); });
+  expect_distribution(f, { 2, 4, 0, 3 });
+}
+
+TEST(TrainerTests, tournament_selection_favors_the_best) {
+
+  auto rng = make_rng();
+  algo::sel::tournament<mt19937_64> sel(rng, 2);
+  EXPECT_FALSE(sel.meta().ranked);
+  sel.prepare({ 3, 1, 4, 2 });
+
+  // The best of two uniform draws out of m is rank r with probability
+  // (2(m - r) - 1)/m^2.
+  auto f = frequencies(4, [&]() { return sel.exec(); });
+  expect_distribution(f, { 3, 7, 1, 5 });
+}
+
+} // namespace
@@ -0,0 +1,88 @@
+#include "internal/surrogate.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+namespace {
+
+using namespace marslander;
+using namespace marslander::trainer;
+using namespace std;
+
+const vector<double> weights{ 2., -1., .5 };
+constexpr double intercept = 4.;
+
+pb::genome make_genome(mt19937_64& rng) {
+  uniform_real_distribution<> d(-10., 10.);
+  pb::genome g;
+  for (size_t i = 0; i < weights.size(); ++i) g.add_genes(d(rng));
+  return g;
+}
+
+double linear(const pb::genome& g) {
+  double r = intercept;
+  for (size_t i = 0; i < weights.size(); ++i)
+    r += weights[i] * g.genes(int(i));
+  return r;
+}
+
+TEST(TrainerTests, surrogate_recovers_a_linear_model) {
+
+  mt19937_64 rng(::testing::UnitTest::GetInstance()->random_seed());
+  surrogate_model m;
+  for (size_t k = 0; k < 50; ++k) {
+    auto g = make_genome(rng);
+    m.observe(g, linear(g));
+  }
+  EXPECT_EQ(m.observed(), 50);
+  ASSERT_TRUE(m.fit(1e-9));
+  ASSERT_TRUE(m.fitted());
+
+  for (size_t k = 0; k < 10; ++k) {
+    auto g = make_genome(rng);
+    EXPECT_NEAR(m.predict(g), linear(g), 1e-6);
+  }
+
+  pb::genome other;
+  other.add_genes(1.);
+  EXPECT_TRUE(std::isnan(m.predict(other)));
+}
+
+TEST(TrainerTests, surrogate_needs_more_observations_than_dimensions) {
+
+  mt19937_64 rng(::testing::UnitTest::GetInstance()->random_seed());
+  surrogate_model m;
+  for (size_t k = 0; k <= weights.size(); ++k) {
+    auto g = make_genome(rng);
+    m.observe(g, linear(g));
+  }
+  EXPECT_FALSE(m.fit(1e-9));
+  EXPECT_TRUE(std::isnan(m.predict(make_genome(rng))));
+
+  auto g = make_genome(rng);
+  m.observe(g, linear(g));
+  EXPECT_TRUE(m.fit(1e-9));
+
+  // Genomes of another size start the history over.
+  pb::genome other;
+  other.add_genes(1.);
+  m.observe(other, 1.);
+  EXPECT_EQ(m.observed(), 1);
+  EXPECT_FALSE(m.fitted());
+}
+
+TEST(TrainerTests, rank_correlation_of_monotone_values) {
+
+  vector<double> x{ 1., 5., 2., 8., 3. };
+  vector<double> increasing{ 10., 50., 20., 80., 30. };
+  vector<double> decreasing{ -1., -25., -4., -64., -9. };
+
+  EXPECT_DOUBLE_EQ(rank_correlation(x, increasing), 1.);
+  EXPECT_DOUBLE_EQ(rank_correlation(x, decreasing), -1.);
+  EXPECT_TRUE(std::isnan(rank_correlation(vector<double>{ 1. },
+    vector<double>{ 2. })));
+}
+
+} // namespace
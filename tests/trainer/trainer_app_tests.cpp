@@ -0,0 +1,604 @@
+// The trainer is an executable, so the code under test is built in here.
+#include "internal/trainer_app_persistency.cpp"
+#include "internal/trainer_app_fidelity.cpp"
+#include "internal/trainer_app_racing.cpp"
+#include "internal/trainer_app_state.cpp"
+#include "internal/trainer_app_steady_state.cpp"
+#include "internal/trainer_app_work_units.cpp"
+#include "internal/mapped_file.cpp"
+
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace marslander::trainer {
+
+logger_ptr app::_logger = std::make_shared<spdlog::logger>("trainer_tests");
+
+// Steady state reaches for these on the app; islands and the data directory
+// are out of the picture here.
+std::filesystem::path app::get_data_path() const { return {}; }
+bool app::is_migration_due(const app_state&) const { return false; }
+void app::emigrate(const app_state&, app_state::population_t&&) {}
+
+struct app_tests final {
+  static constexpr auto& training_filename = app::training_filename;
+  static constexpr auto& journal_filename = app::journal_filename;
+  static constexpr auto& ratings_filename = app::ratings_filename;
+
+  static bool check_integrity(const mapped_file& f) {
+    return app::check_integrity(f);
+  }
+  static void persist_state(app_state& s, const std::filesystem::path& d) {
+    app::persist_state(s, d);
+  }
+  static bool restore_session(app_state& s, const std::filesystem::path& d) {
+    return app::restore_session(s, d);
+  }
+  static void log_ratings(app_state& s, const std::filesystem::path& d,
+      const std::vector<app_state::rating_record>& ratings) {
+    app::log_ratings(s, d, ratings);
+  }
+  static size_t restore_ratings(app_state& s, const std::filesystem::path& d) {
+    return app::restore_ratings(s, d);
+  }
+  static void replace_worst(app_state& s, size_t j) {
+    app::replace_worst(s, j);
+  }
+};
+
+} // namespace marslander::trainer
+
+namespace {
+
+using namespace marslander;
+using namespace marslander::trainer;
+using namespace std;
+
+struct session_directory final {
+  filesystem::path path = filesystem::temp_directory_path()
+    / ("trainer_app_tests." + to_string(
+        ::testing::UnitTest::GetInstance()->random_seed()));
+
+  session_directory() {
+    filesystem::remove_all(path);
+    filesystem::create_directories(path);
+  }
+  ~session_directory() { filesystem::remove_all(path); }
+
+  filesystem::path training() const {
+    return path / app_tests::training_filename;
+  }
+  filesystem::path journal() const {
+    return path / app_tests::journal_filename;
+  }
+  filesystem::path ratings(size_t generation) const {
+    return path / (string(app_tests::ratings_filename) + '.'
+      + to_string(generation));
+  }
+};
+
+constexpr size_t cases_count = 2, population_size = 3;
+
+void init_state(app_state& s) {
+  s.check = 0x5eed;
+  s.generation = 1;
+  s.cases_count = cases_count;
+  s.population_size = population_size;
+  s.elite_count = 1;
+  s.tournament_size = 2;
+  s.crossover = { "heuristic", { .5 } };
+  s.mutation = { "uniform", { .1 } };
+  s.uids = uid_source(100);
+  s.journal.interval = 10;
+
+  for (size_t k = 0; k < cases_count; ++k) {
+    auto& c = s.cases.emplace_back();
+    c.set_id(10 + k);
+    c.set_fuel(int32_t(500 + k));
+  }
+  for (size_t i = 0; i < population_size; ++i) {
+    auto& g = s.population.emplace_back();
+    g.set_id(s.uids.next_uid());
+    g.add_genes(double(i));
+    g.add_genes(double(s.generation));
+  }
+}
+
+// The best genome stays, the others get replaced by new ones.
+void next_generation(app_state& s) {
+  ++s.generation;
+  for (size_t i = 1; i < population_size; ++i) {
+    pb::genome g;
+    g.set_id(s.uids.next_uid());
+    g.add_genes(double(i));
+    g.add_genes(double(s.generation));
+    s.population[i] = move(g);
+  }
+}
+
+void expect_population(const app_state& a, const app_state& b) {
+  ASSERT_EQ(a.population.size(), b.population.size());
+  for (size_t i = 0; i < a.population.size(); ++i) {
+    EXPECT_EQ(a.population[i].id(), b.population[i].id());
+    EXPECT_EQ(a.population[i].SerializeAsString(),
+      b.population[i].SerializeAsString());
+  }
+}
+
+// Reads the state back the way a sweep session resumes.
+void expect_restored(const session_directory& dir, const app_state& saved,
+    size_t records) {
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  s.check = saved.check;
+  s.population_size = saved.population_size;
+  ASSERT_TRUE(app_tests::restore_session(s, dir.path));
+  EXPECT_EQ(s.generation, saved.generation);
+  EXPECT_EQ(s.uids.value(), saved.uids.value());
+  EXPECT_EQ(s.journal.records, records);
+  expect_population(s, saved);
+}
+
+TEST(TrainerTests, persistency_replays_checkpoints_up_to_a_torn_tail) {
+
+  session_directory dir;
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  init_state(s);
+  app_tests::persist_state(s, dir.path);
+  EXPECT_EQ(filesystem::file_size(dir.journal()), 0);
+
+  next_generation(s);
+  app_tests::persist_state(s, dir.path);
+  auto psecond = make_unique<app_state>();
+  auto& second = *psecond;
+  init_state(second);
+  second.generation = s.generation;
+  second.uids = uid_source(s.uids.value());
+  second.population = s.population;
+
+  next_generation(s);
+  app_tests::persist_state(s, dir.path);
+  EXPECT_EQ(s.journal.records, 2);
+  expect_restored(dir, s, 2);
+
+  filesystem::resize_file(dir.journal(),
+    filesystem::file_size(dir.journal()) - 3);
+  expect_restored(dir, second, 1);
+}
+
+TEST(TrainerTests, persistency_compacts_the_journal_into_a_new_base) {
+
+  session_directory dir;
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  init_state(s);
+  s.journal.interval = 2;
+  app_tests::persist_state(s, dir.path);
+  next_generation(s);
+  app_tests::persist_state(s, dir.path);
+  EXPECT_GT(filesystem::file_size(dir.journal()), 0);
+
+  next_generation(s);
+  app_tests::persist_state(s, dir.path);
+  EXPECT_EQ(s.journal.records, 0);
+  EXPECT_EQ(filesystem::file_size(dir.journal()), 0);
+  auto tmp = dir.training();
+  tmp += ".tmp";
+  EXPECT_FALSE(filesystem::exists(tmp));
+  expect_restored(dir, s, 0);
+}
+
+TEST(TrainerTests, persistency_keeps_the_base_when_compaction_fails) {
+
+  session_directory dir;
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  init_state(s);
+  s.journal.interval = 2;
+  app_tests::persist_state(s, dir.path);
+  next_generation(s);
+  app_tests::persist_state(s, dir.path);
+
+  auto psecond = make_unique<app_state>();
+  auto& second = *psecond;
+  init_state(second);
+  second.generation = s.generation;
+  second.uids = uid_source(s.uids.value());
+  second.population = s.population;
+
+  // The new base can't be written aside.
+  auto tmp = dir.training();
+  tmp += ".tmp";
+  filesystem::create_directory(tmp);
+  next_generation(s);
+  app_tests::persist_state(s, dir.path);
+  EXPECT_GT(filesystem::file_size(dir.journal()), 0);
+  expect_restored(dir, second, 1);
+}
+
+// Maps training.dat past its header, the way the trainer loads it.
+bool map_training(const session_directory& dir, app_state& s) {
+  auto file = make_shared<const mapped_file>(dir.training());
+  if (!*file || !app_tests::check_integrity(*file)) return false;
+
+  size_t offset;
+  {
+    mapped_buf buf(*file);
+    istream is(&buf);
+    is.seekg(sizeof(checksum::crc32_t));
+    if (!s.read(is, app_state::header)) return false;
+    offset = size_t(is.tellg());
+  }
+  return s.map(move(file), offset);
+}
+
+records_footer footer_of(const session_directory& dir) {
+  records_footer f{};
+  mapped_file file(dir.training());
+  EXPECT_TRUE(read_footer(file, f));
+  return f;
+}
+
+void flip_byte(const filesystem::path& path, size_t offset) {
+  fstream f(path, ios_base::binary | ios_base::in | ios_base::out);
+  f.seekg(offset);
+  auto c = char(f.get());
+  f.seekp(offset);
+  f.put(char(~c));
+}
+
+TEST(TrainerTests, training_dat_maps_records_once_their_sections_verify) {
+
+  session_directory dir;
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  init_state(s);
+  app_tests::persist_state(s, dir.path);
+
+  auto pm = make_unique<app_state>();
+  auto& m = *pm;
+  ASSERT_TRUE(map_training(dir, m));
+  EXPECT_TRUE(m.indexed_layout);
+  EXPECT_TRUE(m.mapped_intact());
+
+  auto g = m.find_genome(s.population[1].id());
+  ASSERT_NE(g, nullptr);
+  EXPECT_EQ(g->SerializeAsString(), s.population[1].SerializeAsString());
+  auto c = m.find_case(11);
+  ASSERT_NE(c, nullptr);
+  EXPECT_EQ(c->fuel(), 501);
+
+  // Records read one by one, as a dump does, match the ones kept.
+  pb::genome read;
+  ASSERT_EQ(m.mapped.population.size(), s.population.size());
+  for (size_t i = 0; i < s.population.size(); ++i) {
+    ASSERT_TRUE(m.mapped.population.read(i, read));
+    EXPECT_EQ(read.SerializeAsString(), s.population[i].SerializeAsString());
+  }
+
+  EXPECT_TRUE(m.unmap_cases());
+  EXPECT_TRUE(m.unmap_population());
+  ASSERT_EQ(m.cases.size(), cases_count);
+  expect_population(m, s);
+}
+
+TEST(TrainerTests, training_dat_detects_a_corrupted_genome_section) {
+
+  session_directory dir;
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  init_state(s);
+  app_tests::persist_state(s, dir.path);
+
+  auto f = footer_of(dir);
+  ASSERT_LT(f.genomes_begin, f.records_end);
+  flip_byte(dir.training(), f.genomes_begin);
+
+  // Records are left out of the whole file check, so the file still maps.
+  auto pm = make_unique<app_state>();
+  auto& m = *pm;
+  ASSERT_TRUE(map_training(dir, m));
+  EXPECT_FALSE(m.mapped_intact());
+  EXPECT_TRUE(m.unmap_cases());
+  EXPECT_FALSE(m.unmap_population());
+
+  auto pr = make_unique<app_state>();
+  auto& r = *pr;
+  r.check = s.check;
+  r.population_size = s.population_size;
+  EXPECT_FALSE(app_tests::restore_session(r, dir.path));
+}
+
+TEST(TrainerTests, training_dat_detects_a_corrupted_header) {
+
+  session_directory dir;
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  init_state(s);
+  app_tests::persist_state(s, dir.path);
+
+  // Past the checksum and the layout marker lies the check.
+  flip_byte(dir.training(), sizeof(checksum::crc32_t) + sizeof(uint64_t));
+  mapped_file file(dir.training());
+  ASSERT_TRUE(file);
+  EXPECT_FALSE(app_tests::check_integrity(file));
+}
+
+// A generation about to be rated.
+void init_ratings(app_state& s) {
+  init_state(s);
+  s.cases_index.rebuild(s.cases.begin(), s.cases.end());
+  s.population_index.rebuild(s.population.begin(), s.population.end());
+  s.results.resize(cases_count, population_size,
+    numeric_limits<results_table::value_type>::quiet_NaN());
+}
+
+TEST(TrainerTests, ratings_log_restores_the_generation_up_to_a_torn_record) {
+
+  session_directory dir;
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  init_ratings(s);
+  auto g0 = s.population[0].id(), g1 = s.population[1].id(),
+    g2 = s.population[2].id();
+  app_tests::log_ratings(s, dir.path, { { g0, 10, 1.5 }, { g1, 11, 2.5 } });
+  app_tests::log_ratings(s, dir.path, { { g2, 10, 3.5 } });
+  s.ratings_log.file.close();
+  filesystem::resize_file(dir.ratings(s.generation),
+    filesystem::file_size(dir.ratings(s.generation)) - 2);
+
+  auto pr = make_unique<app_state>();
+  auto& r = *pr;
+  init_ratings(r);
+  r.results[1][1] = 7.;
+  EXPECT_EQ(app_tests::restore_ratings(r, dir.path), 1);
+  EXPECT_EQ(r.results[0][0], 1.5);
+  EXPECT_EQ(r.results[1][1], 7.);
+  EXPECT_TRUE(std::isnan(r.results[2][0]));
+  EXPECT_TRUE(std::isnan(r.results[0][1]));
+  r.ratings_log.file.close();
+
+  // The log is rewritten with the ratings restored only.
+  auto pa = make_unique<app_state>();
+  auto& again = *pa;
+  init_ratings(again);
+  EXPECT_EQ(app_tests::restore_ratings(again, dir.path), 1);
+  EXPECT_EQ(again.results[0][0], 1.5);
+  EXPECT_TRUE(std::isnan(again.results[1][1]));
+}
+
+TEST(TrainerTests, ratings_log_of_a_generation_stays_until_a_later_save) {
+
+  session_directory dir;
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  init_ratings(s);
+  auto first = s.generation;
+  app_tests::log_ratings(s, dir.path,
+    { { s.population[0].id(), 10, 1.5 } });
+
+  // The next generation logs aside, while its checkpoint is being saved.
+  ++s.generation;
+  app_tests::log_ratings(s, dir.path,
+    { { s.population[1].id(), 10, 2.5 } });
+  s.ratings_log.file.close();
+  EXPECT_TRUE(filesystem::exists(dir.ratings(first)));
+  EXPECT_TRUE(filesystem::exists(dir.ratings(s.generation)));
+
+  app_tests::persist_state(s, dir.path);
+  EXPECT_FALSE(filesystem::exists(dir.ratings(first)));
+  EXPECT_TRUE(filesystem::exists(dir.ratings(s.generation)));
+
+  auto pr = make_unique<app_state>();
+  auto& r = *pr;
+  init_ratings(r);
+  r.generation = s.generation;
+  EXPECT_EQ(app_tests::restore_ratings(r, dir.path), 1);
+  EXPECT_TRUE(std::isnan(r.results[0][0]));
+  EXPECT_EQ(r.results[1][0], 2.5);
+  r.ratings_log.file.close();
+}
+
+TEST(TrainerTests, ratings_log_skips_other_generations) {
+
+  session_directory dir;
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  init_ratings(s);
+  app_tests::log_ratings(s, dir.path,
+    { { s.population[0].id(), 10, 1.5 } });
+  s.ratings_log.file.close();
+
+  auto pr = make_unique<app_state>();
+  auto& r = *pr;
+  init_ratings(r);
+  r.generation = s.generation + 1;
+  EXPECT_EQ(app_tests::restore_ratings(r, dir.path), 0);
+  EXPECT_TRUE(std::isnan(r.results[0][0]));
+
+  // The first ratings of the generation start the log over.
+  app_tests::log_ratings(r, dir.path,
+    { { r.population[1].id(), 11, 2.5 } });
+  r.ratings_log.file.close();
+  auto pa = make_unique<app_state>();
+  auto& again = *pa;
+  init_ratings(again);
+  again.generation = r.generation;
+  EXPECT_EQ(app_tests::restore_ratings(again, dir.path), 1);
+  EXPECT_TRUE(std::isnan(again.results[0][0]));
+  EXPECT_EQ(again.results[1][1], 2.5);
+}
+
+// A pool of population_size genomes scored in order, and one offspring.
+void init_steady_state(app_state& s, const vector<score_t>& scores) {
+  init_state(s);
+  auto& child = s.population.emplace_back();
+  child.set_id(s.uids.next_uid());
+  child.add_genes(-1.);
+  child.add_genes(-1.);
+
+  s.rebuild_indices();
+  s.scores = scores;
+  s.pool_sel = make_unique<algo::sel::tournament<app_state::random_engine_t>>(
+    s.prng, s.tournament_size);
+  s.pool_sel->prepare(s.scores);
+  s.cache.resize(4);
+  s.genes_keys.clear();
+  for (auto& g : s.population) s.genes_keys.push_back(fitness_cache::hash(g));
+  s.results.resize(cases_count, s.population.size(),
+    numeric_limits<results_table::value_type>::quiet_NaN());
+}
+
+void rate(app_state& s, size_t i, results_table::value_type rating) {
+  auto row = s.results[i];
+  fill(row, row + s.results.cols(), rating);
+}
+
+TEST(TrainerTests, steady_state_offspring_replaces_the_worst_of_the_pool) {
+
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  init_steady_state(s, { 1., 5., 3. });
+  auto worst = s.population[1], child = s.population[population_size];
+  rate(s, population_size, 2.);
+  app_tests::replace_worst(s, population_size);
+
+  EXPECT_EQ(s.population[1].id(), child.id());
+  EXPECT_EQ(s.population[population_size].id(), worst.id());
+  EXPECT_EQ(s.scores, (vector<score_t>{ 1., 2., 3. }));
+  EXPECT_EQ(s.population_index.find(child.id()), 1);
+  EXPECT_EQ(s.population_index.find(worst.id()), population_size);
+  EXPECT_EQ(s.genes_keys[1], fitness_cache::hash(child));
+
+  auto ratings = s.cache.find(fitness_cache::hash(child), child);
+  ASSERT_NE(ratings, nullptr);
+  EXPECT_EQ(*ratings, vector<double>(cases_count, 2.));
+}
+
+TEST(TrainerTests, steady_state_offspring_no_better_than_the_worst_is_dropped) {
+
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  init_steady_state(s, { 1., 5., 3. });
+  vector<marslander::uid_t> ids;
+  for (auto& g : s.population) ids.push_back(g.id());
+  rate(s, population_size, 5.);
+  app_tests::replace_worst(s, population_size);
+
+  for (size_t i = 0; i < ids.size(); ++i)
+    EXPECT_EQ(s.population[i].id(), ids[i]);
+  EXPECT_EQ(s.scores, (vector<score_t>{ 1., 5., 3. }));
+  // Its ratings are remembered all the same.
+  auto& child = s.population[population_size];
+  EXPECT_NE(s.cache.find(fitness_cache::hash(child), child), nullptr);
+}
+
+TEST(TrainerTests, work_units_cover_the_window_a_block_each) {
+
+  constexpr size_t n = 7, i = 2;
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  s.cases.resize(n);
+
+  // Windows of all cases and of a racing stage, wrapping past the end
+  // of cases, split into unit counts that don't divide them.
+  for (auto [begin, end] :
+      { pair<size_t, size_t>{ 0, n }, { 2, 7 }, { 1, 4 } })
+  for (size_t offset : { size_t{0}, size_t{5} })
+  for (size_t units : { size_t{1}, size_t{2}, size_t{3}, end - begin }) {
+    s.race.offset = offset;
+    s.race.stage_begin = begin;
+    s.race.stage_end = end;
+    s.units_per_genome = units;
+
+    size_t covered = begin;
+    for (size_t b = 0; b < units; ++b) {
+      auto [from, count] = s.unit_block(i * units + b);
+      EXPECT_EQ(from, covered);
+      EXPECT_GT(count, 0);
+      covered = from + count;
+    }
+    EXPECT_EQ(covered, end);
+
+    for (size_t case_ind = 0; case_ind < n; ++case_ind) {
+      auto k = (case_ind + n - offset) % n;
+      auto u = s.unit_of(i, case_ind);
+      if (k < begin || k >= end) {
+        EXPECT_EQ(u, numeric_limits<size_t>::max());
+        continue;
+      }
+
+      ASSERT_EQ(u / units, i);
+      auto [from, count] = s.unit_block(u);
+      EXPECT_LE(from, k) << "case " << case_ind << ", " << units << " units";
+      EXPECT_LT(k, from + count)
+        << "case " << case_ind << ", " << units << " units";
+    }
+  }
+}
+
+// Rates genome i on cases [from; to) of the racing window.
+void rate_window(app_state& s, size_t i, size_t from, size_t to,
+    results_table::value_type rating) {
+  auto n = s.cases.size();
+  for (auto k = from; k < to; ++k)
+    s.results[i][(s.race.offset + k) % n] = rating;
+}
+
+TEST(TrainerTests, racing_culls_the_bottom_of_each_stage) {
+
+  constexpr size_t n = 8, genomes = 4;
+  auto ps = make_unique<app_state>();
+  auto& s = *ps;
+  s.cases.resize(n);
+  s.population.resize(genomes);
+  s.population_size = genomes;
+  s.elite_count = 1;
+  s.race.min_cases = 2;
+  s.race.keep = .5;
+  s.results.resize(n, genomes,
+    numeric_limits<results_table::value_type>::quiet_NaN());
+  s.begin_race();
+  s.reset_units();
+  ASSERT_TRUE(s.racing());
+  EXPECT_EQ(s.race.stage_begin, 0);
+  EXPECT_EQ(s.race.stage_end, 2);
+
+  // Genome i rates i + 1 everywhere; the stage isn't over until all of
+  // the alive ones are rated on it.
+  for (size_t i = 0; i + 1 < genomes; ++i) rate_window(s, i, 0, 2, i + 1.);
+  EXPECT_FALSE(s.advance_race());
+  rate_window(s, genomes - 1, 0, 2, double(genomes));
+  ASSERT_TRUE(s.advance_race());
+
+  EXPECT_EQ(s.race.stage_begin, 2);
+  EXPECT_EQ(s.race.stage_end, 4);
+  EXPECT_EQ(s.race.culled, (vector<bool>{ false, false, true, true }));
+  EXPECT_EQ(s.race.culled_count, 2);
+  EXPECT_EQ(s.race.simulations_saved, 2 * (n - 2));
+  // Culled genomes are rated as the worst seen, and need no more units.
+  for (size_t k = 0; k < n; ++k) EXPECT_EQ(s.results[3][k], 4.);
+  EXPECT_TRUE(s.dispatcher.done(2));
+  EXPECT_TRUE(s.dispatcher.done(3));
+  EXPECT_FALSE(s.dispatcher.done(0));
+
+  for (size_t i = 0; i < 2; ++i) rate_window(s, i, 2, 4, i + 1.);
+  ASSERT_TRUE(s.advance_race());
+  EXPECT_EQ(s.race.stage_begin, 4);
+  EXPECT_EQ(s.race.stage_end, n);
+  EXPECT_EQ(s.race.culled, (vector<bool>{ false, true, true, true }));
+
+  // The last stage completes along with the generation.
+  rate_window(s, 0, 4, n, 1.);
+  EXPECT_FALSE(s.advance_race());
+  EXPECT_EQ(s.race.culled_count, 3);
+}
+
+} // namespace
@@ -0,0 +1,180 @@
+// The trainer is an executable, so the code under test is built in here.
+#include "internal/trainer_data_import.cpp"
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+namespace {
+
+using namespace marslander;
+using namespace std;
+
+vector<pb::landing_case> import_text(const std::string& text) {
+  auto path = filesystem::temp_directory_path()
+    / ("import_cases_tests." + to_string(
+        ::testing::UnitTest::GetInstance()->random_seed()) + ".txt");
+  ofstream(path, ios_base::binary) << text;
+  try {
+    auto cases = data::import_cases(path);
+    filesystem::remove(path);
+    return cases;
+  }
+  catch (...) {
+    filesystem::remove(path);
+    throw;
+  }
+}
+
+// The first case of test_cases.txt.
+void expect_easy_on_the_right(const pb::landing_case& c) {
+  EXPECT_EQ(c.position().x(), 2500);
+  EXPECT_EQ(c.position().y(), 2700);
+  EXPECT_EQ(c.velocity().x(), 0);
+  EXPECT_EQ(c.velocity().y(), 0);
+  EXPECT_EQ(c.fuel(), 550);
+  EXPECT_EQ(c.tilt(), 0);
+  EXPECT_EQ(c.thrust(), 0);
+  EXPECT_EQ(c.safe_area().start(), 4);
+  EXPECT_EQ(c.safe_area().end(), 5);
+  ASSERT_EQ(c.surface_size(), 7);
+  EXPECT_EQ(c.surface(0).x(), 0);
+  EXPECT_EQ(c.surface(0).y(), 100);
+  EXPECT_EQ(c.surface(6).x(), 6999);
+  EXPECT_EQ(c.surface(6).y(), 800);
+}
+
+// The second case of test_cases.txt.
+void expect_correct_side(const pb::landing_case& c) {
+  EXPECT_EQ(c.position().x(), 6500);
+  EXPECT_EQ(c.position().y(), 2800);
+  EXPECT_EQ(c.velocity().x(), -100);
+  EXPECT_EQ(c.fuel(), 600);
+  EXPECT_EQ(c.tilt(), 90);
+  EXPECT_EQ(c.safe_area().start(), 2);
+  EXPECT_EQ(c.safe_area().end(), 3);
+  ASSERT_EQ(c.surface_size(), 4);
+  EXPECT_EQ(c.surface(3).x(), 3000);
+  EXPECT_EQ(c.surface(3).y(), 100);
+}
+
+constexpr char easy_json[] = R"({
+  "name": "Easy on The Right",
+  "fuel": 550, "thrust": 0, "tilt": 0,
+  "safe_area": {"start": 4, "end": 5},
+  "position": {"x": 2500, "y": 2700},
+  "velocity": {"x": 0, "y": 0},
+  "surface": [
+    {"x": 0, "y": 100}, {"x": 1000, "y": 500}, {"x": 1500, "y": 1500},
+    {"x": 3000, "y": 1000}, {"x": 4000, "y": 150}, {"x": 5500, "y": 150},
+    {"x": 6999, "y": 800}
+  ]
+})";
+
+constexpr char correct_side_json[] = R"({"id": 7, "fuel": 600,)"
+  R"( "thrust": 0, "tilt": 90, "tags": ["speed", {"x": 1}], "extra": null,)"
+  R"( "safe_area": {"start": 2, "end": 3, "note": "flat"},)"
+  R"( "position": {"x": 6500, "y": 2800},)"
+  R"( "velocity": {"x": -100, "y": 0},)"
+  R"( "surface": [{"x": 0, "y": 100}, {"x": 1000, "y": 500},)"
+  R"( {"x": 1500, "y": 100, "z": 9}, {"x": 3000, "y": 100}]})";
+
+TEST(TrainerTests, import_cases_json_array) {
+
+  auto cases = import_text("[" + std::string(easy_json) + ",\n"
+    + correct_side_json + "]\n");
+  ASSERT_EQ(cases.size(), 2);
+  expect_easy_on_the_right(cases[0]);
+  expect_correct_side(cases[1]);
+  EXPECT_EQ(cases[1].id(), 7);
+}
+
+TEST(TrainerTests, import_cases_json_objects) {
+
+  auto cases = import_text(std::string(easy_json) + "\n"
+    + correct_side_json + "\n");
+  ASSERT_EQ(cases.size(), 2);
+  expect_easy_on_the_right(cases[0]);
+  expect_correct_side(cases[1]);
+}
+
+TEST(TrainerTests, import_cases_malformed_json) {
+
+  EXPECT_THROW(import_text(R"([{"fuel": 550,}])"), runtime_error);
+}
+
+TEST(TrainerTests, import_cases_text) {
+
+  auto cases = import_text(
+    "# Easy on the right\r\n"
+    "landscape: [{0; 100}, {1000; 500}, {1500; 1500}, {3000; 1000}, "
+      "{4000; 150}, {5500; 150}, {6999; 800}]\r\n"
+    "position: 2500; 2700 hspeed: 0 vspeed: 0 fuel: 550 tile: 0 "
+      "thrust: 0\r\n"
+    "flat surface: { {4000; 150}; {5500; 150} }\r\n"
+    "\r\n"
+    "  // indented\r\n"
+    "  # Initial speed, correct side\r\n"
+    "  landscape: [{0; 100}, {1000; 500}, {1500; 100}, {3000; 100}]\r\n"
+    "  position: 6500; 2800 hspeed: -100 vspeed: 0 fuel: 600 tile: 90 "
+      "thrust: 0\r\n"
+    "  flat surface: { {1500; 100}, {3000; 100} }\r\n");
+  ASSERT_EQ(cases.size(), 2);
+  expect_easy_on_the_right(cases[0]);
+  expect_correct_side(cases[1]);
+}
+
+TEST(TrainerTests, import_cases_tab_separated) {
+
+  auto cases = import_text(
+    "// TSV\n"
+    "\n"
+    "# Easy on the right\n"
+    "landscape:\n"
+    "X\t0\t1000\t1500\t3000\t4000\t5500\t6999\n"
+    "Y\t100\t500\t1500\t1000\t150\t150\t800\n"
+    "\t\t\t\t\t^\t^\n"
+    "position:\thspeed:\tvspeed:\tfuel:\ttile:\tthrust:\n"
+    "2500; 2700\t0\t0\t550\t0\t0\n"
+    "\n"
+    "# Initial speed, correct side\n"
+    "landscape:\n"
+    " X\t0\t1000\t1500\t3000\n"
+    " Y\t100\t500\t100\t100\n"
+    "\t\t\t^\t^\n"
+    "position:\thspeed:\tvspeed:\tfuel:\ttile:\tthrust:\n"
+    "6500; 2800\t-100\t0\t600\t90\t0\n");
+  ASSERT_EQ(cases.size(), 2);
+  expect_easy_on_the_right(cases[0]);
+  expect_correct_side(cases[1]);
+}
+
+TEST(TrainerTests, import_cases_malformed_text) {
+
+  auto expect_failure = [](const std::string& text, const char* message) {
+    try {
+      import_text(text);
+      ADD_FAILURE() << "no error for: " << text;
+    }
+    catch (const runtime_error& e) {
+      EXPECT_NE(std::string(e.what()).find(message), std::string::npos)
+        << e.what();
+    }
+  };
+
+  expect_failure("# Case\nlandscape: [{0; 100}, {1000; 500}]\n"
+    "velocity: 0; 0\n", "at line 3: unknown line");
+  expect_failure("# Case\nlandscape: [{0; 100}, {1000; 500}]\n"
+    "position: 1; 2 hspeed: 3\n", "at line 3: expected 7 position values");
+  expect_failure("# Case\nlandscape: [{0; 100}, {1000; 500}]\n"
+    "position: 500; 2700 hspeed: 0 vspeed: 0 fuel: 1 tile: 0 thrust: 0\n"
+    "flat surface: { {0; 200}, {1000; 200} }\n",
+    "at line 4: the flat surface is not a part of the landscape");
+  expect_failure("# Case\nlandscape: [{0; 100}, {1000; 500}]\n",
+    "the last case is incomplete");
+}
+
+} // namespace
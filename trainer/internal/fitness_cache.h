@@ -0,0 +1,114 @@
+#include "global_includes.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace marslander::trainer {
+
+// Bounded LRU map from gene vectors to their per-case ratings.
+// Entries are keyed by a content hash; genes are compared on lookup,
+// so a hash collision degrades into a miss rather than a wrong rating.
+class fitness_cache final {
+
+public:
+
+  using key_type = uint64_t;
+  using value_type = double;
+  using ratings_type = std::vector<value_type>;
+
+private:
+
+  struct entry final {
+    key_type key;
+    std::vector<double> genes;
+    ratings_type ratings;
+  };
+
+  using entries_t = std::list<entry>;
+  entries_t _entries;
+  std::unordered_map<key_type, entries_t::iterator> _map;
+
+  size_t _capacity;
+
+  static bool same_genes(const entry& e, const pb::genome& g) {
+    auto& genes = g.genes();
+    return e.genes.size() == size_t(genes.size())
+      && std::equal(genes.begin(), genes.end(), e.genes.begin());
+  }
+
+  void evict() {
+    while (_entries.size() > _capacity) {
+      _map.erase(_entries.back().key);
+      _entries.pop_back();
+    }
+  }
+
+public:
+
+  explicit fitness_cache(size_t capacity = 0)
+    : _capacity{capacity}
+    {}
+
+  size_t capacity() const noexcept { return _capacity; }
+  size_t size() const noexcept { return _entries.size(); }
+
+  void resize(size_t capacity) {
+    _capacity = capacity;
+    evict();
+  }
+
+  void clear() {
+    _map.clear();
+    _entries.clear();
+  }
+
+  // FNV-1a over the raw bit patterns of genes.
+  static key_type hash(const pb::genome& g) {
+    key_type h = 0xcbf29ce484222325ull;
+    for (auto v : g.genes()) {
+      uint64_t bits;
+      std::memcpy(&bits, &v, sizeof(bits));
+      for (int i = 0; i < 8; ++i, bits >>= 8) {
+        h ^= bits & 0xff;
+        h *= 0x100000001b3ull;
+      }
+    }
+    return h;
+  }
+
+  const ratings_type* find(key_type key, const pb::genome& g) {
+    auto it = _map.find(key);
+    if (it == _map.end() || !same_genes(*it->second, g))
+      return nullptr;
+
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return &it->second->ratings;
+  }
+
+  template<typename It>
+  void insert(key_type key, const pb::genome& g, It from, It to) {
+    if (_capacity <= 0) return;
+
+    auto it = _map.find(key);
+    if (it != _map.end()) {
+      _entries.splice(_entries.begin(), _entries, it->second);
+      auto& e = *it->second;
+      e.genes.assign(g.genes().begin(), g.genes().end());
+      e.ratings.assign(from, to);
+      return;
+    }
+
+    _entries.push_front(entry{key,
+      {g.genes().begin(), g.genes().end()}, {from, to}});
+    _map.emplace(key, _entries.begin());
+    evict();
+  }
+
+};
+
+} // namespace marslander::trainer
@@ -0,0 +1,187 @@
+#include "history.h"
+#include "global_includes.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+namespace marslander::trainer::history {
+
+using namespace std;
+
+namespace {
+
+constexpr uint64_t footer_marker = 0x3130545349484c4dULL;
+
+// Columns are little-endian whatever the host.
+template<typename T>
+uint64_t to_le(T value) {
+  static_assert(sizeof(T) == sizeof(uint64_t));
+  uint64_t u;
+  memcpy(&u, &value, sizeof(u));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  u = __builtin_bswap64(u);
+#endif
+  return u;
+}
+
+template<typename T>
+T from_le(uint64_t u) {
+  static_assert(sizeof(T) == sizeof(uint64_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  u = __builtin_bswap64(u);
+#endif
+  T value;
+  memcpy(&value, &u, sizeof(value));
+  return value;
+}
+
+template<typename T>
+void write_column(ostream& os, const vector<T>& column) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  vector<uint64_t> le(column.size());
+  transform(column.begin(), column.end(), le.begin(), to_le<T>);
+  os.write(reinterpret_cast<const char*>(le.data()),
+    streamsize(sizeof(uint64_t) * le.size()));
+#else
+  static_assert(sizeof(T) == sizeof(uint64_t));
+  os.write(reinterpret_cast<const char*>(column.data()),
+    streamsize(sizeof(T) * column.size()));
+#endif
+}
+
+template<typename T>
+bool read_column(istream& is, vector<T>& column) {
+  static_assert(sizeof(T) == sizeof(uint64_t));
+  is.read(reinterpret_cast<char*>(column.data()),
+    streamsize(sizeof(T) * column.size()));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  for (auto& v : column) {
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    v = from_le<T>(u);
+  }
+#endif
+  return bool(is);
+}
+
+void write_u64(ostream& os, uint64_t value) {
+  value = to_le(value);
+  os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+bool read_u64(istream& is, uint64_t& value) {
+  if (!is.read(reinterpret_cast<char*>(&value), sizeof(value))) return false;
+  value = from_le<uint64_t>(value);
+  return true;
+}
+
+// Offsets of the blocks of an archive, as listed by its footer; if the
+// footer is missing (the last append was cut short), they're found by
+// walking the blocks from the start. The end of the last block is
+// returned in `end`.
+vector<uint64_t> read_index(istream& is, uint64_t& end) {
+  vector<uint64_t> offsets;
+  end = 0;
+
+  is.seekg(0, ios_base::end);
+  auto size = uint64_t(is.tellg());
+  uint64_t count, marker;
+  if (size >= 2 * sizeof(uint64_t)
+      && is.seekg(size - 2 * sizeof(uint64_t), ios_base::beg)
+      && read_u64(is, count) && read_u64(is, marker)
+      && marker == footer_marker
+      && count <= (size - 2 * sizeof(uint64_t)) / sizeof(uint64_t)) {
+    end = size - (count + 2) * sizeof(uint64_t);
+    offsets.resize(count);
+    is.seekg(streamoff(end), ios_base::beg);
+    if (read_column(is, offsets)) return offsets;
+  }
+
+  offsets.clear();
+  is.clear();
+  is.seekg(0, ios_base::beg);
+  for (uint64_t ofs = 0;;) {
+    uint64_t header[4];
+    is.seekg(streamoff(ofs), ios_base::beg);
+    for (auto& v : header) read_u64(is, v);
+    if (!is) break;
+
+    auto n = header[1], m = header[2], e = header[3];
+    auto block_end = ofs + sizeof(header)
+      + sizeof(uint64_t) * (2 * n + m + e);
+    if (block_end > size || block_end < ofs) break;
+
+    offsets.push_back(ofs);
+    ofs = end = block_end;
+  }
+  is.clear();
+  return offsets;
+}
+
+} // namespace
+
+bool append(const filesystem::path& path, const generation_history& h) {
+  fstream f(path, ios_base::in | ios_base::out | ios_base::binary);
+  if (!f) f.open(path, ios_base::in | ios_base::out | ios_base::binary
+    | ios_base::trunc);
+  if (!f) return false;
+
+  uint64_t end;
+  auto offsets = read_index(f, end);
+  offsets.push_back(end);
+
+  f.seekp(streamoff(end), ios_base::beg);
+  write_u64(f, h.generation);
+  write_u64(f, h.scores.size());
+  write_u64(f, h.landing_rates.size());
+  write_u64(f, h.elite_ids.size());
+  write_column(f, h.scores);
+  write_column(f, h.ids);
+  write_column(f, h.landing_rates);
+  write_column(f, h.elite_ids);
+
+  write_column(f, offsets);
+  write_u64(f, offsets.size());
+  write_u64(f, footer_marker);
+
+  // Whatever followed a footer recovered by walking the blocks is junk.
+  auto size = uint64_t(f.tellp());
+  f.close();
+  if (!f) return false;
+  error_code ec;
+  auto file_size = filesystem::file_size(path, ec);
+  if (!ec && file_size > size) filesystem::resize_file(path, size, ec);
+  return !ec;
+}
+
+bool read(const filesystem::path& path, vector<generation_history>& out) {
+  ifstream f(path, ios_base::binary);
+  if (!f) return false;
+
+  uint64_t end;
+  for (auto ofs : read_index(f, end)) {
+    f.seekg(streamoff(ofs), ios_base::beg);
+    uint64_t generation, n, m, e;
+    if (!read_u64(f, generation) || !read_u64(f, n) || !read_u64(f, m)
+        || !read_u64(f, e)
+        || n > end || m > end || e > end || ofs > end
+        || (end - ofs) / sizeof(uint64_t) < 4 + 2 * n + m + e)
+      return false;
+
+    auto& h = out.emplace_back();
+    h.generation = generation;
+    h.scores.resize(n);
+    h.ids.resize(n);
+    h.landing_rates.resize(m);
+    h.elite_ids.resize(e);
+    if (!read_column(f, h.scores) || !read_column(f, h.ids)
+        || !read_column(f, h.landing_rates) || !read_column(f, h.elite_ids))
+      return false;
+  }
+  return true;
+}
+
+} // namespace marslander::trainer::history
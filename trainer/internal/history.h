@@ -0,0 +1,34 @@
+#include "global_includes.h"
+
+#include <filesystem>
+#include <vector>
+
+namespace marslander::trainer {
+
+// A generation as kept in the history archive: a block of fixed-width
+// little-endian columns:
+//   u64 generation, population n, cases m, elites e;
+//   f64 scores[n]; u64 genome ids[n]; f64 landing rates[m];
+//   u64 elite ids[e].
+// The footer follows the blocks: u64 offsets[k], u64 k, u64 marker.
+struct generation_history final {
+  size_t generation;
+  std::vector<double> scores;
+  std::vector<uid_t> ids, elite_ids;
+  std::vector<double> landing_rates;
+};
+
+namespace history {
+
+// Appends a generation to the archive, which is created if missing; the
+// new block overwrites the footer, which is written anew past it.
+// Returns false if the archive can't be written.
+bool append(const std::filesystem::path&, const generation_history&);
+
+// Reads every generation of the archive back, in order of appending.
+// Returns false if the archive can't be opened or a block is cut short.
+bool read(const std::filesystem::path&, std::vector<generation_history>&);
+
+} // namespace history
+
+} // namespace marslander::trainer
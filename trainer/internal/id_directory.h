@@ -0,0 +1,188 @@
+#include "global_includes.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace marslander::trainer {
+
+// Resolves uids to positions of a sequence in O(1). Since uids come from
+// a monotonic source, those of a population mostly form a dense range, so
+// they're looked up in a flat table at (id - base); when the range gets
+// too sparse (e.g. long living steady-state pool members), the table turns
+// into a linear probing hash table.
+// Slots are tagged with a rebuild epoch, so a rebuild doesn't have to
+// clear the table, and its storage is reused across generations.
+class id_directory final {
+
+public:
+
+  using pos_type = uint32_t;
+  static constexpr pos_type npos = ~pos_type{};
+
+private:
+
+  struct slot final {
+    uid_t id;
+    uint32_t tag;
+    pos_type pos;
+  };
+
+  std::vector<slot> _slots;
+  size_t _capacity, _size;
+  uint32_t _tag;
+  uid_t _base;
+  bool _dense;
+
+  static constexpr size_t dense_slack = 64;
+
+  bool occupied(const slot& s) const noexcept { return s.tag == _tag; }
+
+  size_t home(uid_t id) const noexcept {
+    return size_t(id * 0x9e3779b97f4a7c15ull) & (_capacity - 1);
+  }
+
+  void new_epoch(size_t capacity) {
+    if (++_tag == 0) {
+      for (auto& s : _slots) s.tag = 0;
+      _tag = 1;
+    }
+    if (_slots.size() < capacity)
+      _slots.resize(std::max(capacity, 2 * _slots.size()), slot{0, 0, 0});
+    _capacity = capacity;
+    _size = 0;
+  }
+
+  std::vector<std::pair<uid_t, pos_type>> entries() const {
+    std::vector<std::pair<uid_t, pos_type>> r;
+    r.reserve(_size);
+    for (size_t i = 0; i < _capacity; ++i)
+      if (occupied(_slots[i])) r.emplace_back(_slots[i].id, _slots[i].pos);
+    return r;
+  }
+
+  void rehash(size_t count) {
+    auto kept = entries();
+    size_t capacity = 16;
+    while (capacity < 2 * count) capacity <<= 1;
+
+    _dense = false;
+    new_epoch(capacity);
+    for (auto [id, pos] : kept) hash_insert(id, pos);
+  }
+
+  void hash_insert(uid_t id, pos_type pos) {
+    for (auto i = home(id);; i = (i + 1) & (_capacity - 1)) {
+      auto& s = _slots[i];
+      if (occupied(s) && s.id != id) continue;
+      if (!occupied(s)) ++_size;
+      s = slot{id, _tag, pos};
+      return;
+    }
+  }
+
+  size_t hash_find(uid_t id) const {
+    for (auto i = home(id);; i = (i + 1) & (_capacity - 1)) {
+      auto& s = _slots[i];
+      if (!occupied(s)) return _capacity;
+      if (s.id == id) return i;
+    }
+  }
+
+public:
+
+  id_directory()
+    : _capacity{}, _size{}, _tag{}, _base{}, _dense{true}
+    {}
+
+  size_t size() const noexcept { return _size; }
+
+  // Positions are assigned in the order of the sequence.
+  template<class It>
+  void rebuild(It first, It last) {
+    auto count = size_t(std::distance(first, last));
+    if (count <= 0) {
+      _dense = true;
+      _base = 0;
+      new_epoch(0);
+      return;
+    }
+
+    auto [min_it, max_it] = std::minmax_element(first, last,
+      [](auto& a, auto& b) { return a.id() < b.id(); });
+    auto span = size_t(max_it->id() - min_it->id()) + 1;
+
+    if (span <= 2 * count + dense_slack) {
+      _dense = true;
+      _base = min_it->id();
+      new_epoch(span);
+    }
+    else {
+      _dense = false;
+      size_t capacity = 16;
+      while (capacity < 2 * count) capacity <<= 1;
+      new_epoch(capacity);
+    }
+
+    pos_type pos = 0;
+    for (auto it = first; it != last; ++it) insert(it->id(), pos++);
+  }
+
+  pos_type find(uid_t id) const {
+    if (_dense) {
+      if (id < _base || id - _base >= _capacity) return npos;
+      auto& s = _slots[id - _base];
+      return occupied(s) ? s.pos : npos;
+    }
+
+    if (_capacity <= 0) return npos;
+    auto i = hash_find(id);
+    return i < _capacity ? _slots[i].pos : npos;
+  }
+
+  void insert(uid_t id, pos_type pos) {
+    if (_dense) {
+      if (id >= _base && id - _base < _capacity) {
+        auto& s = _slots[id - _base];
+        if (!occupied(s)) ++_size;
+        s = slot{id, _tag, pos};
+        return;
+      }
+      rehash(_size + 1);
+    }
+    else if (2 * (_size + 1) > _capacity) rehash(_size + 1);
+
+    hash_insert(id, pos);
+  }
+
+  void erase(uid_t id) {
+    if (_dense) {
+      if (id < _base || id - _base >= _capacity) return;
+      auto& s = _slots[id - _base];
+      if (occupied(s)) { s.tag = 0; --_size; }
+      return;
+    }
+
+    if (_capacity <= 0) return;
+    auto i = hash_find(id);
+    if (i >= _capacity) return;
+
+    // Backward shift deletion keeps probe sequences unbroken.
+    const auto mask = _capacity - 1;
+    for (auto j = i;;) {
+      j = (j + 1) & mask;
+      if (!occupied(_slots[j])) break;
+      auto k = home(_slots[j].id);
+      if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+        _slots[i] = _slots[j];
+        i = j;
+      }
+    }
+    _slots[i].tag = 0;
+    --_size;
+  }
+
+};
+
+} // namespace marslander::trainer
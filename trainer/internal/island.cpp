@@ -0,0 +1,69 @@
+#include "island.h"
+#include "global_includes.h"
+
+#include "sockpp/tcp_connector.h"
+
+#include <google/protobuf/arena.h>
+
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <vector>
+
+namespace marslander::trainer {
+
+namespace island {
+
+using namespace std;
+
+namespace {
+
+static logger_ptr logger_;
+static inline logger_ptr logger() {
+  if (!logger_) logger_ = spdlog::get(loggers::trainer_logger);
+  return logger_;
+}
+
+const pb::messages_factory_mapping factory_
+  = pb::build_messages_factory_mapping();
+
+// A peer island that's down or stuck must not hold back the next round.
+constexpr chrono::seconds peer_timeout{5};
+
+void send_to(const sockpp::inet_address& peer, const pb::migrants& msg) {
+  sockpp::tcp_connector conn(peer, peer_timeout);
+  if (!conn) throw io::transfer_error(conn);
+  if (!conn.read_timeout(peer_timeout) || !conn.write_timeout(peer_timeout))
+    throw io::transfer_error(conn);
+
+  io::write(conn, msg);
+  if (!conn.shutdown(SHUT_WR)) throw io::transfer_error(conn);
+
+  // The response carries no messages; it only confirms delivery.
+  std::vector<io::any_message> messages;
+  google::protobuf::Arena arena;
+  io::read(conn, factory_, &arena, messages);
+}
+
+} // namespace
+
+future<void> emigrate(const peers_t& peers, pb::migrants&& msg) {
+  return async(launch::async,
+    [peers, msg = move(msg)] () {
+      for (auto& peer : peers) {
+        try {
+          send_to(peer, msg);
+          SPDLOG_LOGGER_INFO(logger(), "{} < Sent {} migrants.",
+            peer, msg.data_size());
+        }
+        catch (const exception& ex) {
+          SPDLOG_LOGGER_WARN(logger(), "{} : migration failed; {}",
+            peer, ex.what());
+        }
+      }
+    });
+}
+
+} // namespace island
+
+} // namespace marslander::trainer
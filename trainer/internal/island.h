@@ -0,0 +1,20 @@
+#include "global_includes.h"
+
+#include "sockpp/inet_address.h"
+
+#include <future>
+#include <vector>
+
+namespace marslander::trainer {
+
+namespace island {
+
+using peers_t = std::vector<sockpp::inet_address>;
+
+// Sends migrants to every peer in the background; a peer that can't be
+// reached is logged and skipped, so islands may come and go freely.
+std::future<void> emigrate(const peers_t& peers, pb::migrants&& msg);
+
+} // namespace island
+
+} // namespace marslander::trainer
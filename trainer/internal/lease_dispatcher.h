@@ -0,0 +1,240 @@
+#include "global_includes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace marslander::trainer {
+
+// Hands out work items (work units of population) to runners as leases.
+// Items ready to go wait in a FIFO queue; leased items are watched by
+// a heap of deadlines, so an item whose lease expires is queued again
+// without a scan over the whole population. A lease lasts according to
+// the measured throughput of its runner and is extended by heartbeats.
+class lease_dispatcher final {
+
+public:
+
+  using clock_t = std::chrono::steady_clock;
+  using time_point = clock_t::time_point;
+  using duration = clock_t::duration;
+  using pos_type = uint32_t;
+
+  // Lease length for a runner with no throughput measured yet.
+  static constexpr auto default_lease = std::chrono::seconds(30);
+  static constexpr auto min_lease = std::chrono::seconds(5);
+  // Grace period granted by a heartbeat.
+  static constexpr auto heartbeat_lease = std::chrono::seconds(10);
+
+private:
+
+  enum class item_state : uint8_t { ready, leased, done };
+
+  struct item final {
+    item_state state;
+    uint32_t holder;
+    time_point deadline;
+  };
+
+  struct runner_info final {
+    duration per_item, per_simulation;
+    time_point lease_start;
+    std::vector<pos_type> held;
+  };
+
+  std::vector<item> _items;
+  std::deque<pos_type> _ready;
+  // Items completed or re-readied leave stale entries in _ready, which
+  // are skipped on lease; so ready items are counted apart.
+  size_t _ready_count, _done_count;
+
+  // Unfinished items are linked in a list (the sentinel is at size()), so
+  // that the tail of a generation is walked without a scan of all items.
+  std::vector<pos_type> _prev, _next;
+
+  void link(pos_type pos) {
+    auto end = pos_type(_items.size());
+    _prev[pos] = end;
+    _next[pos] = _next[end];
+    _prev[_next[end]] = pos;
+    _next[end] = pos;
+  }
+
+  void unlink(pos_type pos) {
+    _next[_prev[pos]] = _next[pos];
+    _prev[_next[pos]] = _prev[pos];
+  }
+
+  using deadline_t = std::pair<time_point, pos_type>;
+  std::priority_queue<deadline_t, std::vector<deadline_t>,
+    std::greater<deadline_t>> _deadlines;
+
+  std::unordered_map<std::string, uint32_t> _runner_ids;
+  std::vector<runner_info> _runners;
+
+  runner_info& runner(const std::string& name, uint32_t& id) {
+    auto [it, inserted] = _runner_ids.try_emplace(name,
+      uint32_t(_runners.size()));
+    if (inserted) _runners.push_back(
+      runner_info{duration::zero(), duration::zero(), {}, {}});
+    id = it->second;
+    return _runners[id];
+  }
+
+  void expire(time_point now) {
+    while (!_deadlines.empty() && _deadlines.top().first <= now) {
+      auto [deadline, pos] = _deadlines.top();
+      _deadlines.pop();
+
+      auto& it = _items[pos];
+      if (it.state == item_state::leased && it.deadline == deadline)
+        make_ready(pos);
+    }
+  }
+
+public:
+
+  lease_dispatcher() : _ready_count{}, _done_count{}, _prev(1), _next(1) {}
+
+  // All items become ready, in order.
+  void reset(size_t count) {
+    _items.assign(count, item{item_state::ready, 0, time_point()});
+    _ready.clear();
+    for (size_t i = 0; i < count; ++i) _ready.push_back(pos_type(i));
+    _prev.resize(count + 1);
+    _next.resize(count + 1);
+    for (size_t i = 0; i <= count; ++i) {
+      _prev[i] = pos_type(i > 0 ? i - 1 : count);
+      _next[i] = pos_type(i < count ? i + 1 : 0);
+    }
+    _deadlines = decltype(_deadlines)();
+    _ready_count = count;
+    _done_count = 0;
+    for (auto& r : _runners) r.held.clear();
+  }
+
+  size_t size() const noexcept { return _items.size(); }
+  size_t unfinished() const noexcept { return _items.size() - _done_count; }
+  size_t ready() const noexcept { return _ready_count; }
+  bool leased(size_t i) const { return _items[i].state == item_state::leased; }
+  bool done(size_t i) const { return _items[i].state == item_state::done; }
+
+  bool leased_to(size_t i, const std::string& name) const {
+    auto r = _runner_ids.find(name);
+    return r != _runner_ids.end() && leased(i)
+      && _items[i].holder == r->second;
+  }
+
+  void make_ready(size_t i) {
+    auto& it = _items[i];
+    if (it.state == item_state::ready) return;
+    if (it.state == item_state::done) {
+      --_done_count;
+      link(pos_type(i));
+    }
+    it.state = item_state::ready;
+    ++_ready_count;
+    _ready.push_back(pos_type(i));
+  }
+
+  void complete(size_t i) {
+    auto& it = _items[i];
+    if (it.state == item_state::done) return;
+    if (it.state == item_state::ready) --_ready_count;
+    it.state = item_state::done;
+    ++_done_count;
+    unlink(pos_type(i));
+  }
+
+  // Calls f(position) for unfinished items until it returns false.
+  template<class F>
+  void for_each_unfinished(F&& f) const {
+    auto end = pos_type(_items.size());
+    for (auto pos = _next[end]; pos != end; pos = _next[pos])
+      if (!f(size_t(pos))) return;
+  }
+
+  // A runner reporting back is done with its previous lease, so its
+  // throughput is measured; items of that lease left unfinished wait for
+  // their deadlines (the report may still be partial).
+  void report(const std::string& name, time_point now, size_t simulations) {
+    uint32_t id;
+    auto& r = runner(name, id);
+    if (r.held.empty()) return;
+
+    auto elapsed = now - r.lease_start;
+    auto smooth = [](duration& avg, duration sample) {
+      avg = avg == duration::zero() ? sample : (7 * avg + 3 * sample) / 10;
+    };
+    smooth(r.per_item, elapsed / r.held.size());
+    if (simulations > 0) smooth(r.per_simulation, elapsed / simulations);
+    r.held.clear();
+  }
+
+  // Mean time a runner takes per simulation; zero until measured.
+  duration simulation_time() const {
+    duration sum{};
+    duration::rep n = 0;
+    for (auto& r : _runners) {
+      if (r.per_simulation == duration::zero()) continue;
+      sum += r.per_simulation;
+      ++n;
+    }
+    return n > 0 ? sum / n : duration::zero();
+  }
+
+  void heartbeat(const std::string& name, time_point now) {
+    uint32_t id;
+    auto& r = runner(name, id);
+    for (auto pos : r.held) {
+      auto& it = _items[pos];
+      if (it.state != item_state::leased || it.holder != id) continue;
+      if (it.deadline >= now + heartbeat_lease) continue;
+
+      it.deadline = now + heartbeat_lease;
+      _deadlines.push({it.deadline, pos});
+    }
+  }
+
+  // Calls f(position) for at most `count` ready items leased to a runner.
+  template<class F>
+  size_t lease(const std::string& name, time_point now, size_t count, F&& f) {
+    expire(now);
+
+    uint32_t id;
+    auto& r = runner(name, id);
+    duration length = default_lease;
+    if (r.per_item != duration::zero()) {
+      auto expected = r.per_item * std::min(count, _ready_count);
+      length = std::clamp<duration>(3 * expected, min_lease, 4 * default_lease);
+    }
+
+    r.lease_start = now;
+    size_t n = 0;
+    while (n < count && !_ready.empty()) {
+      auto pos = _ready.front();
+      _ready.pop_front();
+
+      auto& it = _items[pos];
+      if (it.state != item_state::ready) continue;
+
+      it = item{item_state::leased, id, now + length};
+      --_ready_count;
+      _deadlines.push({it.deadline, pos});
+      r.held.push_back(pos);
+      f(size_t(pos));
+      ++n;
+    }
+    return n;
+  }
+
+};
+
+} // namespace marslander::trainer
@@ -0,0 +1,69 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace marslander::trainer {
+
+using namespace std;
+
+mapped_file::mapped_file(const filesystem::path& path)
+  : _data{}, _size{}, _open{} {
+
+  auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return;
+
+  struct stat st;
+  if (::fstat(fd, &st) == 0) {
+    _size = size_t(st.st_size);
+    _open = true;
+    if (_size > 0) {
+      auto p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        _data = static_cast<const char*>(p);
+      }
+      else {
+        _size = 0;
+        _open = false;
+      }
+    }
+  }
+
+  ::close(fd);
+}
+
+mapped_file::~mapped_file() {
+  if (_data) ::munmap(const_cast<char*>(_data), _size);
+}
+
+bool mapped_file::index(size_t& offset, size_t count, spans_t& spans) const {
+  spans.clear();
+  spans.reserve(min(count, _size / sizeof(size_t)));
+  for (size_t i = 0; i < count; ++i) {
+    size_t sz;
+    if (offset > _size || _size - offset < sizeof(sz)) return false;
+    memcpy(&sz, _data + offset, sizeof(sz));
+    offset += sizeof(sz);
+    if (_size - offset < sz) return false;
+    spans.emplace_back(offset, sz);
+    offset += sz;
+  }
+  return true;
+}
+
+bool mapped_file::rebase(size_t base, spans_t& spans) const {
+  for (auto& [offset, size] : spans) {
+    if (base > _size || offset > _size - base
+        || size > _size - base - offset)
+      return false;
+    offset += base;
+  }
+  return true;
+}
+
+} // namespace marslander::trainer
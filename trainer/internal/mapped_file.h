@@ -0,0 +1,127 @@
+#pragma once
+
+#ifndef TRAINER_INTERNAL_MAPPED_FILE_H_
+#define TRAINER_INTERNAL_MAPPED_FILE_H_
+
+#include "global_includes.h"
+
+#include <filesystem>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <utility>
+#include <vector>
+
+namespace marslander::trainer {
+
+// A file mapped into memory read-only; a file that can't be opened (or
+// mapped) tests false, an empty one has no data.
+class mapped_file final {
+
+  const char* _data;
+  size_t _size;
+  bool _open;
+
+public:
+
+  explicit mapped_file(const std::filesystem::path&);
+  ~mapped_file();
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  explicit operator bool() const noexcept { return _open; }
+  const char* data() const noexcept { return _data; }
+  size_t size() const noexcept { return _size; }
+
+  // (offset, size) of records within the file.
+  using spans_t = std::vector<std::pair<size_t, size_t>>;
+
+  // Locates count size-prefixed records starting at offset, which is
+  // advanced past them; false when the file ends before.
+  bool index(size_t& offset, size_t count, spans_t& spans) const;
+
+  // Makes spans relative to base absolute; false when any of them ends
+  // past the file.
+  bool rebase(size_t base, spans_t& spans) const;
+
+};
+
+// Reads a mapped file through std::istream.
+class mapped_buf final : public std::streambuf {
+
+public:
+
+  mapped_buf(const mapped_file& file) {
+    auto first = const_cast<char*>(file.data());
+    setg(first, first, first + file.size());
+  }
+
+protected:
+
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+      std::ios_base::openmode which) override {
+    auto from = dir == std::ios_base::beg ? eback()
+      : dir == std::ios_base::cur ? gptr() : egptr();
+    if (!(which & std::ios_base::in)
+        || off < eback() - from || off > egptr() - from)
+      return pos_type(off_type(-1));
+
+    setg(eback(), from + off, egptr());
+    return pos_type(gptr() - eback());
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+
+};
+
+// Size-prefixed protobuf records of a mapped file, each one parsed on
+// first touch; records may be touched concurrently. Slots for the parsed
+// records are allocated on the first touch as well, so a pass that reads
+// records one by one with read() takes no memory per record.
+template<class T>
+class record_view final {
+
+  std::shared_ptr<const mapped_file> _file;
+  mapped_file::spans_t _spans;
+  mutable std::unique_ptr<T[]> _items;
+  mutable std::unique_ptr<std::once_flag[]> _parsed;
+  std::unique_ptr<std::once_flag> _allocated;
+
+public:
+
+  record_view() = default;
+  record_view(std::shared_ptr<const mapped_file> file,
+      mapped_file::spans_t&& spans)
+    : _file(std::move(file)), _spans(std::move(spans)),
+      _allocated(std::make_unique<std::once_flag>()) {}
+
+  size_t size() const noexcept { return _spans.size(); }
+
+  const T& operator[](size_t i) const {
+    std::call_once(*_allocated, [this]() {
+      _items = std::make_unique<T[]>(_spans.size());
+      _parsed = std::make_unique<std::once_flag[]>(_spans.size());
+    });
+    std::call_once(_parsed[i], [this, i]() { read(i, _items[i]); });
+    return _items[i];
+  }
+
+  // Parses a record into `item` without keeping it.
+  bool read(size_t i, T& item) const {
+    auto [offset, size] = _spans[i];
+    // Checksums covering the records have been verified already.
+    return item.ParseFromArray(_file->data() + offset, int(size));
+  }
+
+  // Hands a record over, parsing it if it hasn't been touched yet.
+  T take(size_t i) { (*this)[i]; return std::move(_items[i]); }
+
+};
+
+} // namespace marslander::trainer
+
+#endif // TRAINER_INTERNAL_MAPPED_FILE_H_
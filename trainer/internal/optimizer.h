@@ -0,0 +1,356 @@
+#include "global_includes.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace marslander::trainer {
+
+// An optimizer engine replaces the GA generation step entirely: it gets
+// scores of the evaluated population (lower is better) and overwrites
+// the population with the next generation to evaluate.
+template<typename T>
+struct optimizer_algo_tmpl_ {
+  using population_t = std::vector<T>;
+  using scores_t = std::vector<score_t>;
+  using state_t = std::vector<double>;
+  virtual void exec(const scores_t&, population_t&) = 0;
+  virtual state_t save() const = 0;
+  virtual bool load(const state_t&) = 0;
+  virtual ~optimizer_algo_tmpl_() = default;
+};
+
+using optimizer_algo = optimizer_algo_tmpl_<pb::genome>;
+
+namespace detail_ {
+
+// Cyclic Jacobi eigenvalue algorithm for a symmetric n x n matrix `a`
+// (row-major, destroyed); eigenvectors are stored in columns of `v`.
+inline void eigen_symmetric(size_t n, std::vector<double>& a,
+    std::vector<double>& v, std::vector<double>& eigenvalues) {
+  v.assign(n * n, 0.);
+  for (size_t i = 0; i < n; ++i) v[i * n + i] = 1.;
+
+  for (int sweep = 0; sweep < 64; ++sweep) {
+    double off = 0.;
+    for (size_t p = 0; p < n; ++p)
+    for (size_t q = p + 1; q < n; ++q)
+      off += a[p * n + q] * a[p * n + q];
+    if (off < 1e-30) break;
+
+    for (size_t p = 0; p < n; ++p)
+    for (size_t q = p + 1; q < n; ++q) {
+      auto apq = a[p * n + q];
+      if (std::abs(apq) < 1e-300) continue;
+
+      auto theta = (a[q * n + q] - a[p * n + p]) / (2. * apq);
+      auto t = (theta >= 0 ? 1. : -1.)
+        / (std::abs(theta) + std::sqrt(theta * theta + 1.));
+      auto c = 1. / std::sqrt(t * t + 1.), s = t * c;
+
+      for (size_t k = 0; k < n; ++k) {
+        auto akp = a[k * n + p], akq = a[k * n + q];
+        a[k * n + p] = c * akp - s * akq;
+        a[k * n + q] = s * akp + c * akq;
+      }
+      for (size_t k = 0; k < n; ++k) {
+        auto apk = a[p * n + k], aqk = a[q * n + k];
+        a[p * n + k] = c * apk - s * aqk;
+        a[q * n + k] = s * apk + c * aqk;
+      }
+      for (size_t k = 0; k < n; ++k) {
+        auto vkp = v[k * n + p], vkq = v[k * n + q];
+        v[k * n + p] = c * vkp - s * vkq;
+        v[k * n + q] = s * vkp + c * vkq;
+      }
+    }
+  }
+
+  eigenvalues.resize(n);
+  for (size_t i = 0; i < n; ++i) eigenvalues[i] = a[i * n + i];
+}
+
+} // namespace detail_
+
+namespace algo::opt {
+
+// CMA-ES as described in 'The CMA Evolution Strategy: A Tutorial'
+// - N. Hansen; the separable variant keeps a diagonal covariance matrix
+// with learning rates raised as in 'A Simple Modification in CMA-ES
+// Achieving Linear Time and Space Complexity' - R. Ros, N. Hansen.
+template<typename Rng>
+class cma_es final : public optimizer_algo {
+  using base_ = optimizer_algo;
+
+  std::shared_ptr<Rng> _prng;
+  const double _sigma0;
+  const bool _separable;
+
+  // Persisted distribution state
+  size_t _n, _updates;
+  double _sigma;
+  std::vector<double> _mean, _pc, _ps, _c;
+
+  // Eigendecomposition of _c (full variant), sqrt of eigenvalues in _d
+  std::vector<double> _b, _d;
+  bool _decomposed;
+
+  struct params {
+    size_t mu;
+    std::vector<double> w;
+    double mueff, cc, cs, c1, cmu, damps, chi_n;
+  };
+
+  params make_params(size_t lambda) const {
+    params r;
+    const double n = double(_n);
+    r.mu = std::max<size_t>(lambda / 2, 1);
+    r.w.resize(r.mu);
+    for (size_t i = 0; i < r.mu; ++i)
+      r.w[i] = std::log(r.mu + .5) - std::log(i + 1.);
+    auto w_sum = std::accumulate(r.w.begin(), r.w.end(), 0.);
+    for (auto& w : r.w) w /= w_sum;
+    r.mueff = 1. / std::inner_product(r.w.begin(), r.w.end(), r.w.begin(), 0.);
+
+    r.cc = (4. + r.mueff / n) / (n + 4. + 2. * r.mueff / n);
+    r.cs = (r.mueff + 2.) / (n + r.mueff + 5.);
+    r.c1 = 2. / ((n + 1.3) * (n + 1.3) + r.mueff);
+    r.cmu = std::min(1. - r.c1,
+      2. * (r.mueff - 2. + 1. / r.mueff) / ((n + 2.) * (n + 2.) + r.mueff));
+    if (_separable) {
+      r.c1 = std::min(1., r.c1 * (n + 2.) / 3.);
+      r.cmu = std::min(1. - r.c1, r.cmu * (n + 2.) / 3.);
+    }
+    r.damps = 1. + 2. * std::max(0., std::sqrt((r.mueff - 1.) / (n + 1.)) - 1.)
+      + r.cs;
+    r.chi_n = std::sqrt(n) * (1. - 1. / (4. * n) + 1. / (21. * n * n));
+    return r;
+  }
+
+  double& c_at(size_t i, size_t j) { return _c[i * _n + j]; }
+
+  void decompose() {
+    if (_decomposed) return;
+    _decomposed = true;
+
+    if (_separable) {
+      _d.resize(_n);
+      std::transform(_c.begin(), _c.end(), _d.begin(),
+        [](auto c) { return std::sqrt(std::max(c, 1e-20)); });
+      return;
+    }
+
+    for (size_t i = 0; i < _n; ++i)
+    for (size_t j = 0; j < i; ++j)
+      c_at(j, i) = c_at(i, j) = .5 * (c_at(i, j) + c_at(j, i));
+
+    auto a = _c;
+    detail_::eigen_symmetric(_n, a, _b, _d);
+    for (auto& d : _d) d = std::sqrt(std::max(d, 1e-20));
+  }
+
+  // y = C^(1/2) z
+  void transform_normal(const std::vector<double>& z, std::vector<double>& y) {
+    y.assign(_n, 0.);
+    if (_separable) {
+      for (size_t i = 0; i < _n; ++i) y[i] = _d[i] * z[i];
+      return;
+    }
+    for (size_t i = 0; i < _n; ++i)
+    for (size_t j = 0; j < _n; ++j)
+      y[i] += _b[i * _n + j] * _d[j] * z[j];
+  }
+
+  // z = C^(-1/2) y
+  void inv_sqrt_c(const std::vector<double>& y, std::vector<double>& z) {
+    z.assign(_n, 0.);
+    if (_separable) {
+      for (size_t i = 0; i < _n; ++i) z[i] = y[i] / _d[i];
+      return;
+    }
+    std::vector<double> t(_n, 0.);
+    for (size_t j = 0; j < _n; ++j) {
+      for (size_t i = 0; i < _n; ++i) t[j] += _b[i * _n + j] * y[i];
+      t[j] /= _d[j];
+    }
+    for (size_t i = 0; i < _n; ++i)
+    for (size_t j = 0; j < _n; ++j)
+      z[i] += _b[i * _n + j] * t[j];
+  }
+
+  static std::vector<size_t> ranking(const base_::scores_t& scores) {
+    std::vector<size_t> inds(scores.size());
+    std::iota(inds.begin(), inds.end(), 0);
+    std::sort(inds.begin(), inds.end(),
+      [&scores](auto u, auto v) { return scores[u] < scores[v]; });
+    return inds;
+  }
+
+  void init(const base_::scores_t& scores, const base_::population_t& p) {
+    _n = size_t(p.front().genes_size());
+    _updates = 0;
+    _pc.assign(_n, 0.);
+    _ps.assign(_n, 0.);
+    _c.assign(_separable ? _n : _n * _n, 0.);
+    if (_separable) std::fill(_c.begin(), _c.end(), 1.);
+    else for (size_t i = 0; i < _n; ++i) c_at(i, i) = 1.;
+    _decomposed = false;
+
+    auto r = make_params(p.size());
+    auto inds = ranking(scores);
+    _mean.assign(_n, 0.);
+    for (size_t k = 0; k < r.mu; ++k) {
+      auto& genes = p[inds[k]].genes();
+      for (size_t i = 0; i < _n; ++i) _mean[i] += r.w[k] * genes[i];
+    }
+
+    _sigma = _sigma0;
+    if (_sigma <= 0) {
+      // Start from the spread of the initial population.
+      double var = 0.;
+      for (auto& g : p)
+      for (size_t i = 0; i < _n; ++i)
+        var += (g.genes(i) - _mean[i]) * (g.genes(i) - _mean[i]);
+      _sigma = std::sqrt(var / (double(p.size()) * _n));
+      if (!(_sigma > 0)) _sigma = 1.;
+    }
+  }
+
+  void update(const base_::scores_t& scores, const base_::population_t& p) {
+    decompose();
+
+    auto r = make_params(p.size());
+    auto inds = ranking(scores);
+    const double n = double(_n);
+
+    auto mean_old = _mean;
+    std::fill(_mean.begin(), _mean.end(), 0.);
+    for (size_t k = 0; k < r.mu; ++k) {
+      auto& genes = p[inds[k]].genes();
+      for (size_t i = 0; i < _n; ++i) _mean[i] += r.w[k] * genes[i];
+    }
+
+    std::vector<double> yw(_n), z;
+    for (size_t i = 0; i < _n; ++i) yw[i] = (_mean[i] - mean_old[i]) / _sigma;
+    inv_sqrt_c(yw, z);
+
+    auto ps_f = std::sqrt(r.cs * (2. - r.cs) * r.mueff);
+    for (size_t i = 0; i < _n; ++i)
+      _ps[i] = (1. - r.cs) * _ps[i] + ps_f * z[i];
+    auto ps_norm = std::sqrt(
+      std::inner_product(_ps.begin(), _ps.end(), _ps.begin(), 0.));
+
+    ++_updates;
+    bool hsig = ps_norm
+      / std::sqrt(1. - std::pow(1. - r.cs, 2. * _updates)) / r.chi_n
+      < 1.4 + 2. / (n + 1.);
+
+    auto pc_f = hsig * std::sqrt(r.cc * (2. - r.cc) * r.mueff);
+    for (size_t i = 0; i < _n; ++i)
+      _pc[i] = (1. - r.cc) * _pc[i] + pc_f * yw[i];
+
+    auto c_old_f = 1. - r.c1 - r.cmu + (1. - hsig) * r.c1 * r.cc * (2. - r.cc);
+    std::vector<std::vector<double>> ys(r.mu, std::vector<double>(_n));
+    for (size_t k = 0; k < r.mu; ++k) {
+      auto& genes = p[inds[k]].genes();
+      for (size_t i = 0; i < _n; ++i)
+        ys[k][i] = (genes[i] - mean_old[i]) / _sigma;
+    }
+
+    if (_separable) {
+      for (size_t i = 0; i < _n; ++i) {
+        double rank_mu = 0.;
+        for (size_t k = 0; k < r.mu; ++k) rank_mu += r.w[k] * ys[k][i] * ys[k][i];
+        _c[i] = c_old_f * _c[i] + r.c1 * _pc[i] * _pc[i] + r.cmu * rank_mu;
+      }
+    }
+    else {
+      for (size_t i = 0; i < _n; ++i)
+      for (size_t j = 0; j <= i; ++j) {
+        double rank_mu = 0.;
+        for (size_t k = 0; k < r.mu; ++k) rank_mu += r.w[k] * ys[k][i] * ys[k][j];
+        c_at(i, j) = c_at(j, i) = c_old_f * c_at(i, j)
+          + r.c1 * _pc[i] * _pc[j] + r.cmu * rank_mu;
+      }
+    }
+
+    _sigma *= std::exp(std::min(1., (r.cs / r.damps) * (ps_norm / r.chi_n - 1.)));
+    _decomposed = false;
+  }
+
+  void sample(base_::population_t& p) {
+    decompose();
+
+    std::normal_distribution<> d_norm;
+    std::vector<double> z(_n), y;
+    for (auto& g : p) {
+      for (auto& v : z) v = d_norm(*_prng);
+      transform_normal(z, y);
+
+      auto genes = g.mutable_genes();
+      genes->Resize(int(_n), 0.);
+      for (size_t i = 0; i < _n; ++i)
+        genes->Set(int(i), _mean[i] + _sigma * y[i]);
+    }
+  }
+
+public:
+
+  cma_es(std::shared_ptr<Rng> prng, double sigma0, bool separable)
+    : _prng(std::move(prng)), _sigma0{sigma0}, _separable{separable},
+      _n{}, _updates{}, _sigma{}, _decomposed{} { }
+
+  void exec(const base_::scores_t& scores, base_::population_t& p) override {
+    assert(scores.size() == p.size());
+    if (p.empty()) return;
+
+    if (_n != size_t(p.front().genes_size())) init(scores, p);
+    else update(scores, p);
+
+    sample(p);
+  }
+
+  base_::state_t save() const override {
+    base_::state_t r;
+    if (_n <= 0) return r;
+
+    r.reserve(3 + 3 * _n + _c.size());
+    r.push_back(double(_n));
+    r.push_back(double(_updates));
+    r.push_back(_sigma);
+    r.insert(r.end(), _mean.begin(), _mean.end());
+    r.insert(r.end(), _pc.begin(), _pc.end());
+    r.insert(r.end(), _ps.begin(), _ps.end());
+    r.insert(r.end(), _c.begin(), _c.end());
+    return r;
+  }
+
+  bool load(const base_::state_t& src) override {
+    _n = 0;
+    if (src.empty()) return true;
+    if (src.size() < 3) return false;
+
+    auto n = size_t(src[0]);
+    if (src.size() != 3 + 3 * n + (_separable ? n : n * n)) return false;
+
+    auto it = std::next(src.begin(), 3);
+    _mean.assign(it, it + n); it += n;
+    _pc.assign(it, it + n); it += n;
+    _ps.assign(it, it + n); it += n;
+    _c.assign(it, src.end());
+
+    _n = n;
+    _updates = size_t(src[1]);
+    _sigma = src[2];
+    _decomposed = false;
+    return true;
+  }
+};
+
+} // namespace algo::opt
+
+} // namespace marslander::trainer
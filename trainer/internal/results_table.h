@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <tuple>
 #include <utility>
@@ -147,7 +148,7 @@ public:
   }
 
   size_t cols() const { return _c; }
-  size_t rows() const { return _c; }
+  size_t rows() const { return _r; }
 
   using       iterator = results_table_iterator<      data_ptr_t>;
   using const_iterator = results_table_iterator<const_data_ptr_t>;
@@ -183,4 +184,10 @@ public:
 
 using results_table = results_table_tmpl_<double>;
 
+// Cells yet to be rated hold NaN.
+template<typename T>
+using unary_pred_fptr = bool (*)(T);
+constexpr inline unary_pred_fptr<results_table::value_type> pred_std_isnan
+  = std::isnan;
+
 } // namespace marslander::trainer
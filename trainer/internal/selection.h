@@ -0,0 +1,167 @@
+#include "global_includes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace marslander::trainer {
+
+struct selection_meta {
+  // Whether candidates must be passed in the order of their scores;
+  // otherwise only elites get sorted.
+  const bool ranked;
+};
+
+// Picks parents among the candidates of a generation (lower score is
+// better). prepare() is called once per generation; exec() may then be
+// called concurrently and returns a candidate position.
+struct selection_algo {
+  using scores_t = std::vector<score_t>;
+  virtual void prepare(const scores_t&) = 0;
+  virtual size_t exec() const = 0;
+  virtual ~selection_algo() = default;
+  const selection_meta& meta() const { return _meta; }
+protected:
+  selection_algo(const selection_meta& meta) : _meta{meta} {}
+private:
+  const selection_meta _meta;
+};
+
+namespace detail_ {
+
+// Walker's alias method (Vose's variant): built in O(n) from weights,
+// samples in O(1) with one index and one real draw.
+class alias_table final {
+  std::vector<double> _prob;
+  std::vector<size_t> _alias;
+
+public:
+  template<class It>
+  void build(It first, It last) {
+    auto n = size_t(std::distance(first, last));
+    _prob.assign(first, last);
+    _alias.assign(n, 0);
+    if (n <= 0) return;
+
+    double sum = 0;
+    for (auto w : _prob) sum += w;
+    if (!(sum > 0) || !std::isfinite(sum)) {
+      std::fill(_prob.begin(), _prob.end(), 1.);
+      return;
+    }
+
+    std::vector<size_t> small, large;
+    for (size_t i = 0; i < n; ++i) {
+      _prob[i] *= n / sum;
+      (_prob[i] < 1. ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty()) {
+      auto s = small.back(), l = large.back();
+      small.pop_back();
+      _alias[s] = l;
+      _prob[l] -= 1. - _prob[s];
+      if (_prob[l] < 1.) { large.pop_back(); small.push_back(l); }
+    }
+    for (auto i : small) _prob[i] = 1.;
+    for (auto i : large) _prob[i] = 1.;
+  }
+
+  size_t size() const noexcept { return _prob.size(); }
+
+  template<typename Rng>
+  size_t operator()(Rng&& rng) const {
+    auto i = std::uniform_int_distribution<size_t>{0, size() - 1}(rng);
+    auto u = std::uniform_real_distribution<>{}(rng);
+    return u < _prob[i] ? i : _alias[i];
+  }
+};
+
+} // namespace detail_
+
+namespace algo::sel {
+
+// Draws k uniform candidates and takes the best one.
+template<typename Rng>
+class tournament final : public selection_algo {
+  std::shared_ptr<Rng> _prng;
+  const size_t _k;
+  scores_t _score;
+public:
+  tournament(std::shared_ptr<Rng> prng, size_t k)
+    : selection_algo({false}), _prng(std::move(prng)),
+      _k{std::max<size_t>(k, 1)} { }
+  void prepare(const scores_t& score) override { _score = score; }
+  size_t exec() const override {
+    std::uniform_int_distribution<size_t> d{0, _score.size() - 1};
+    auto result = d(*_prng);
+    for (auto n = _k; n > 1; --n) {
+      auto v = d(*_prng);
+      if (_score[v] < _score[result]) result = v;
+    }
+    return result;
+  }
+};
+
+// Rank r of m candidates (0 is the best) is picked with probability
+// (2 - s)/m + 2(s - 1)(m - 1 - r)/(m(m - 1)), s in [1; 2].
+template<typename Rng>
+class linear_rank final : public selection_algo {
+  std::shared_ptr<Rng> _prng;
+  const double _s;
+  detail_::alias_table _table;
+public:
+  linear_rank(std::shared_ptr<Rng> prng, double s)
+    : selection_algo({true}), _prng(std::move(prng)), _s{s} { }
+  void prepare(const scores_t& score) override {
+    auto m = score.size();
+    std::vector<double> w(m);
+    for (size_t r = 0; r < m; ++r)
+      w[r] = (2 - _s) + (m > 1 ? 2 * (_s - 1) * (m - 1 - r) / (m - 1.) : 0);
+    _table.build(w.begin(), w.end());
+  }
+  size_t exec() const override { return _table(*_prng); }
+};
+
+// Rank r is picked with probability proportional to c^r, c in (0; 1).
+template<typename Rng>
+class exponential_rank final : public selection_algo {
+  std::shared_ptr<Rng> _prng;
+  const double _c;
+  detail_::alias_table _table;
+public:
+  exponential_rank(std::shared_ptr<Rng> prng, double c)
+    : selection_algo({true}), _prng(std::move(prng)), _c{c} { }
+  void prepare(const scores_t& score) override {
+    std::vector<double> w(score.size());
+    double p = 1.;
+    for (auto& v : w) { v = p; p *= _c; }
+    _table.build(w.begin(), w.end());
+  }
+  size_t exec() const override { return _table(*_prng); }
+};
+
+// Roulette wheel over the distance of a score to the worst one.
+template<typename Rng>
+class proportional final : public selection_algo {
+  std::shared_ptr<Rng> _prng;
+  detail_::alias_table _table;
+public:
+  proportional(std::shared_ptr<Rng> prng)
+    : selection_algo({false}), _prng(std::move(prng)) { }
+  void prepare(const scores_t& score) override {
+    auto worst = score.empty() ? score_t{}
+      : *std::max_element(score.begin(), score.end());
+    std::vector<double> w(score.size());
+    std::transform(score.begin(), score.end(), w.begin(),
+      [worst](auto v) { return double(worst - v); });
+    _table.build(w.begin(), w.end());
+  }
+  size_t exec() const override { return _table(*_prng); }
+};
+
+} // namespace algo::sel
+
+} // namespace marslander::trainer
@@ -5,11 +5,27 @@
 
 #include <google/protobuf/arena.h>
 
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <future>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <system_error>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace marslander::trainer {
@@ -53,12 +69,17 @@ struct response_wait_state final {
 
   response_sink_impl get_sink();
 
+  // Called by the last sink to complete; set before any sink is taken.
+  void on_ready(function<void()> f) { _on_ready = move(f); }
+
 private:
 
   void notify_one()
   {
-    if (++_count == _data.size())
-      _ready_promise.set_value();
+    if (++_count != _data.size()) return;
+    _ready_promise.set_value();
+    // The callback may hold the last reference to the state.
+    if (auto on_ready = move(_on_ready)) on_ready();
   }
 
   vector<data_element_t> _data;
@@ -67,6 +88,7 @@ private:
   counter_t _count;
   promise<void> _ready_promise;
   future<void> _ready;
+  function<void()> _on_ready;
 
 };
 
@@ -105,73 +127,542 @@ response_sink_impl response_wait_state::get_sink() {
 const pb::messages_factory_mapping factory_
   = pb::build_messages_factory_mapping();
 
-atomic_int threads_count;
-inline int max_threads_count() {
+atomic_size_t connections_count_;
+atomic_size_t requests_count_;
+atomic_size_t tasks_count_;
+
+// Posts the messages of a request to their handlers; none is posted
+// when any of them has no handler, as the response would never be ready,
+// nor until all of them are ready: the first handler that isn't is
+// returned then.
+const handler_entry* dispatch(looper& l, const handlers_map_t& handlers,
+    const shared_ptr<io::messages_bag>& msgs, response_wait_state& ws) {
+  for (auto& msg : *msgs) {
+    if (handlers.find(msg.id) == handlers.end())
+      throw io::transfer_error("Unexpected message in a request.");
+  }
+  for (auto& msg : *msgs) {
+    auto& h = handlers.at(msg.id);
+    if (h.ready.valid()
+        && h.ready.wait_for(chrono::seconds(0)) != future_status::ready)
+      return &h;
+  }
+
+  ITERZ_((*msgs), i);
+  while(!ITERZ_END(i)) {
+    auto& msg = *i_it++;
+    l.post(bind(handlers.at(msg.id).callback,
+      request_resources {msgs, &msg}, move(ws.get_sink())));
+  }
+  return nullptr;
+}
+
+// Runs tasks on a fixed number of threads. The queue is full past
+// `limit` tasks, which only the reactor heeds; `on_space` is called once
+// it's not full anymore.
+class worker_pool final {
+
+  mutex _m;
+  condition_variable _cv;
+  deque<function<void()>> _tasks;
+  const size_t _limit;
+  const function<void()> _on_space;
+
+  void run() {
+    for (;;) {
+      function<void()> task;
+      bool space;
+      {
+        unique_lock lk(_m);
+        _cv.wait(lk, [this]() { return !_tasks.empty(); });
+        space = _tasks.size() == _limit;
+        task = move(_tasks.front());
+        _tasks.pop_front();
+        --tasks_count_;
+      }
+      if (space) _on_space();
+      task();
+    }
+  }
+
+public:
+
+  worker_pool(size_t threads, size_t limit, function<void()> on_space)
+    : _limit(limit), _on_space(move(on_space)) {
+    while (threads-- > 0) std::thread(&worker_pool::run, this).detach();
+  }
+
+  void post(function<void()> task) {
+    {
+      lock_guard lk(_m);
+      _tasks.push_back(move(task));
+      ++tasks_count_;
+    }
+    _cv.notify_one();
+  }
+
+  bool full() {
+    lock_guard lk(_m);
+    return _tasks.size() >= _limit;
+  }
+
+};
+
+inline int max_workers_count() {
   return max<int>(thread::hardware_concurrency() - 1, 1);
 }
 
-void server_thread(tcp_acceptor acc, looper& l,
-    const handlers_map_t& handlers) {
-  logger()->info("New server thread #{} begins! ({})",
-    this_thread::get_id(), ++threads_count);
-  [[maybe_unused]] scope::on_exit threads_count_sentry_([]{
-    logger()->info("Server thread #{} finished. ({})",
-      this_thread::get_id(), --threads_count);
-  });
+constexpr size_t max_queued_tasks = 1024;
+
+// Serves all the connections from a single thread, which never blocks:
+// sockets are read and written as they become ready, and requests are
+// taken out of the bytes received as soon as they're whole. Parsing a
+// request and encoding the response are left to the pool, the handlers
+// themselves run on the looper as before; requests for handlers that
+// aren't ready are parked with the reactor meanwhile. The reactor stops
+// reading connections while the pool's queue is full, or as many
+// requests are parked.
+class reactor final {
+
+  enum class mode_t { unknown, one_shot, session };
+
+  struct connection final {
+    tcp_socket sock;
+    inet_address peer;
+    mode_t mode = mode_t::unknown;
+    // Messages in the one-shot request, once its header is in.
+    uint32_t messages_count = 0;
+    string in;
+    deque<string> out;
+    size_t out_offset = 0;
+    // Ids of the requests being served; one-shot requests take 0.
+    set<uint32_t> pending;
+    uint32_t events = 0;
+    bool eof = false;
+    bool taken = false;
+    bool stalled = false;
+    bool failed = false;
+  };
+
+  struct completion final {
+    uint64_t connection_id;
+    uint32_t request_id;
+    string bytes;
+    bool failed;
+  };
+
+  static constexpr uint64_t acceptor_key = 0;
+  static constexpr uint64_t wake_key = 1;
+
+  looper& _l;
+  const handlers_map_t _handlers;
+  tcp_acceptor _acc;
+  const int _epoll;
+  const int _wake;
+  worker_pool _pool;
+
+  uint64_t _next_id;
+  unordered_map<uint64_t, connection> _connections;
+  vector<uint64_t> _stalled;
+
+  mutex _m;
+  vector<completion> _completions;
+
+  // Requests waiting for a handler to be ready, listed by the handler.
+  // Workers hand them over to the reactor, which checks the handlers
+  // every parked_poll while any request waits, and posts the requests
+  // back to the pool once their handler is ready, as the pool has room.
+  using retry_t = function<void()>;
+  vector<pair<const handler_entry*, retry_t>> _parking;
+  unordered_map<const handler_entry*, deque<retry_t>> _parked;
+  atomic_size_t _parked_count;
+  static constexpr auto parked_poll = chrono::milliseconds(50);
+
+  void watch(int op, int fd, uint64_t key, uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.u64 = key;
+    if (::epoll_ctl(_epoll, op, fd, &ev) < 0)
+      throw system_error(errno, generic_category(), "epoll_ctl");
+  }
 
-  inet_address peer;
-  bool spawn;
+  void wake() {
+    uint64_t one = 1;
+    [[maybe_unused]] auto n = ::write(_wake, &one, sizeof(one));
+  }
 
-loop: {
-    tcp_socket sock = acc.accept(&peer);
+  // Runs on a worker.
+  void complete(completion&& c) {
+    {
+      lock_guard lk(_m);
+      _completions.push_back(move(c));
+    }
+    wake();
+  }
 
-    if (spawn = threads_count < max_threads_count()) {
-      std::thread(&server_thread, move(acc), std::ref(l), handlers).detach();
+  // Runs on a worker.
+  void park(const handler_entry* h, retry_t&& retry) {
+    ++_parked_count;
+    {
+      lock_guard lk(_m);
+      _parking.emplace_back(h, move(retry));
     }
+    wake();
+  }
 
-    try {
+  // Posts the requests of the handlers that are ready by now.
+  void resume_parked() {
+    for (auto it = _parked.begin(); it != _parked.end();) {
+      auto& [h, retries] = *it;
+      if (h->ready.wait_for(chrono::seconds(0)) != future_status::ready) {
+        ++it;
+        continue;
+      }
+      while (!retries.empty() && !_pool.full()) {
+        _pool.post(move(retries.front()));
+        retries.pop_front();
+        --_parked_count;
+      }
+      it = retries.empty() ? _parked.erase(it) : next(it);
+    }
+  }
+
+  bool saturated() {
+    return _pool.full() || _parked_count >= max_queued_tasks;
+  }
+
+  void accept() {
+    for (;;) {
+      inet_address peer;
+      tcp_socket sock = _acc.accept(&peer);
+      if (!sock) {
+        auto err = _acc.last_error();
+        if (err != EAGAIN && err != EWOULDBLOCK && err != EINTR)
+          logger()->error("Failed to accept a connection: {}",
+            _acc.last_error_str());
+        return;
+      }
 
       SPDLOG_LOGGER_INFO(logger(), "{} > Incoming connection", peer);
+      auto fd = sock.handle();
+      sock.set_non_blocking();
+      auto id = _next_id++;
+      auto& c = _connections.emplace(id, connection{}).first->second;
+      c.sock = move(sock);
+      c.peer = peer;
+      c.events = EPOLLIN;
+      watch(EPOLL_CTL_ADD, fd, id, c.events);
+      ++connections_count_;
+    }
+  }
+
+  void close(uint64_t id) {
+    auto it = _connections.find(id);
+    if (it == _connections.end()) return;
+
+    auto& c = it->second;
+    if (c.mode == mode_t::session)
+      SPDLOG_LOGGER_INFO(logger(), "{} > Session ends", c.peer);
+    ::epoll_ctl(_epoll, EPOLL_CTL_DEL, c.sock.handle(), nullptr);
+    _connections.erase(it);
+    --connections_count_;
+  }
+
+  // Runs an operation on a connection, then closes it on failure or once
+  // it has nothing left to do, or else watches it for what it waits for.
+  template<typename F>
+  void on_connection(uint64_t id, F&& f) {
+    auto it = _connections.find(id);
+    if (it == _connections.end()) return;
+
+    auto& c = it->second;
+    try {
+      f(c);
+
+      bool idle = c.pending.empty() && c.out.empty();
+      bool done = c.eof || (c.mode == mode_t::one_shot && c.taken);
+      if (!c.failed && !(idle && done)) {
+        uint32_t events = (c.stalled || done ? 0 : EPOLLIN)
+          | (c.out.empty() ? 0 : EPOLLOUT);
+        if (events != c.events) {
+          watch(EPOLL_CTL_MOD, c.sock.handle(), id, events);
+          c.events = events;
+        }
+        return;
+      }
+    }
+    catch(const exception& ex) {
+      logger()->error("{} : {}", c.peer, ex.what());
+    }
+    close(id);
+  }
+
+  void receive(uint64_t id, connection& c) {
+    char buf[64 * 1024];
+    while (!c.stalled) {
+      auto n = c.sock.read(buf, sizeof(buf));
+      if (n == 0) {
+        c.eof = true;
+        return;
+      }
+      if (n < 0) {
+        auto err = c.sock.last_error();
+        if (err == EINTR) continue;
+        if (err == EAGAIN || err == EWOULDBLOCK) return;
+        throw io::transfer_error(c.sock);
+      }
+      c.in.append(buf, size_t(n));
+      decode(id, c);
+    }
+  }
+
+  void send(connection& c) {
+    while (!c.out.empty()) {
+      auto& front = c.out.front();
+      auto n = c.sock.write(front.data() + c.out_offset,
+        front.size() - c.out_offset);
+      if (n < 0) {
+        auto err = c.sock.last_error();
+        if (err == EINTR) continue;
+        if (err == EAGAIN || err == EWOULDBLOCK) return;
+        throw io::transfer_error(c.sock);
+      }
+      c.out_offset += size_t(n);
+      if (c.out_offset == front.size()) {
+        c.out.pop_front();
+        c.out_offset = 0;
+      }
+    }
+  }
+
+  // Takes whole requests out of the bytes received so far.
+  void decode(uint64_t id, connection& c) {
+    size_t pos = 0;
+    if (c.mode == mode_t::unknown) {
+      uint32_t messages_count;
+      if (c.in.size() < sizeof(messages_count)) return;
+      memcpy(&messages_count, c.in.data(), sizeof(messages_count));
+      pos = sizeof(messages_count);
+
+      if (messages_count == io::session_marker) {
+        // Frames are written whole; small ones shouldn't wait for acks.
+        c.sock.set_option(IPPROTO_TCP, TCP_NODELAY, 1);
+        c.out.emplace_back(c.in, 0, sizeof(messages_count));
+        c.mode = mode_t::session;
+        SPDLOG_LOGGER_INFO(logger(), "{} > Session begins", c.peer);
+      }
+      else {
+        if (messages_count == 0)
+          throw io::transfer_error("Empty request.");
+        c.mode = mode_t::one_shot;
+        c.messages_count = messages_count;
+      }
+    }
+
+    while (!(c.mode == mode_t::one_shot && c.taken)) {
+      if (saturated()) {
+        if (!c.stalled) _stalled.push_back(id);
+        c.stalled = true;
+        break;
+      }
+
+      auto data = c.in.data() + pos;
+      auto size = c.in.size() - pos;
+      if (c.mode == mode_t::one_shot) {
+        size_t messages_size;
+        if (!io::messages_size(data, size, c.messages_count, messages_size))
+          break;
+        c.taken = true;
+        take(id, c, 0, c.messages_count, string(data, messages_size));
+        pos += messages_size;
+      }
+      else {
+        uint32_t request_id, messages_count;
+        size_t payload_size;
+        if (!io::frame_size(data, size, request_id, messages_count,
+            payload_size))
+          break;
+        if (messages_count == 0) {
+          throw io::transfer_error("Empty request #"
+            + to_string(request_id) + ".");
+        }
+        take(id, c, request_id, messages_count,
+          string(data + io::frame_header_size, payload_size));
+        pos += io::frame_header_size + payload_size;
+      }
+    }
+
+    c.in.erase(0, pos);
+  }
+
+  void take(uint64_t id, connection& c, uint32_t request_id,
+      uint32_t messages_count, string&& payload) {
+    if (!c.pending.insert(request_id).second)
+      throw io::transfer_error("Request id is in use already.");
+
+    ++requests_count_;
+    _pool.post([this, id, peer = c.peer, session = c.mode == mode_t::session,
+        request_id, messages_count, payload = move(payload)]() {
+      serve(id, peer, session, request_id, messages_count, payload);
+    });
+  }
+
+  // Runs on a worker.
+  void serve(uint64_t id, const inet_address& peer, bool session,
+      uint32_t request_id, uint32_t messages_count, const string& payload) {
+    try {
       std::vector<io::any_message> messages;
       auto arena = std::make_unique<google::protobuf::Arena>();
-      io::read(sock, factory_, arena.get(), messages);
+      io::parse(payload.data(), payload.size(), messages_count, factory_,
+        arena.get(), messages);
       auto msgs = make_shared<io::messages_bag>(
         std::move(arena), std::move(messages));
-      if (msgs->size() <= 0) {
-        logger()->warn("{} : Empty request.", peer);
-        return;
+      if (session) {
+        SPDLOG_LOGGER_INFO(logger(), "{} > Received request #{} "
+          "({} messages).", peer, request_id, msgs->size());
+      }
+      else {
+        SPDLOG_LOGGER_INFO(logger(),
+          "{} > Received request ({} messages).", peer, msgs->size());
       }
-      // TODO: throw on msgs->size() <= 0?
-      SPDLOG_LOGGER_INFO(logger(),
-        "{} > Received request ({} messages).", peer, msgs->size());
-
-      response_wait_state ws(msgs->size());
 
-      ITERZ_((*msgs), i);
-      while(!ITERZ_END(i)) {
-        auto& msg = *i_it++;
-        l.post(bind(handlers.at(msg.id),
-          request_resources {msgs, &msg}, move(ws.get_sink())));
+      // The state keeps itself until the response is ready.
+      auto ws = make_shared<response_wait_state>(msgs->size());
+      ws->on_ready([this, ws, id, peer, session, request_id]() {
+        _pool.post([this, ws, id, peer, session, request_id]() {
+          respond(id, peer, session, request_id, *ws);
+        });
+      });
+      try { dispatch_when_ready(msgs, ws); }
+      catch (...) {
+        ws->on_ready({});
+        throw;
       }
+    }
+    catch(const exception& ex) {
+      logger()->error("{} : {}", peer, ex.what());
+      complete({id, request_id, {}, true});
+    }
+  }
 
-      auto data = ws.wait();
-      // TODO: throw on data.empty()?
-      io::write(sock, data.begin(), data.end());
-      SPDLOG_LOGGER_INFO(logger(),
-        "{} < Written response ({} messages).", peer, data.size());
+  // Runs on a worker; the request is parked while a handler isn't ready,
+  // and posted again once it is.
+  void dispatch_when_ready(const shared_ptr<io::messages_bag>& msgs,
+      const shared_ptr<response_wait_state>& ws) {
+    if (auto h = dispatch(_l, _handlers, msgs, *ws)) {
+      park(h, [this, msgs, ws]() { dispatch_when_ready(msgs, ws); });
+    }
+  }
 
+  // Runs on a worker.
+  void respond(uint64_t id, const inet_address& peer, bool session,
+      uint32_t request_id, response_wait_state& ws) {
+    try {
+      auto data = ws.wait();
+      auto bytes = session
+        ? io::encode_frame(request_id, data.begin(), data.end())
+        : io::encode(data.begin(), data.end());
+      if (session) {
+        SPDLOG_LOGGER_INFO(logger(), "{} < Response #{} is ready "
+          "({} messages).", peer, request_id, data.size());
+      }
+      else {
+        SPDLOG_LOGGER_INFO(logger(),
+          "{} < Response is ready ({} messages).", peer, data.size());
+      }
+      complete({id, request_id, move(bytes), false});
     }
     catch(const exception& ex) {
       logger()->error("{} : {}", peer, ex.what());
+      complete({id, request_id, {}, true});
     }
   }
 
-  if (!spawn) {
-    SPDLOG_LOGGER_INFO(logger(),
-      "Server thread #{} restart.", this_thread::get_id());
-    goto loop;
+  void drain() {
+    uint64_t n;
+    [[maybe_unused]] auto r = ::read(_wake, &n, sizeof(n));
+
+    vector<completion> completions;
+    vector<pair<const handler_entry*, retry_t>> parking;
+    {
+      lock_guard lk(_m);
+      completions.swap(_completions);
+      parking.swap(_parking);
+    }
+    for (auto& done : completions) {
+      // The connection may be gone already.
+      --requests_count_;
+      on_connection(done.connection_id, [this, &done](connection& c) {
+        c.pending.erase(done.request_id);
+        c.failed = done.failed;
+        if (c.failed) return;
+        c.out.push_back(move(done.bytes));
+        send(c);
+      });
+    }
+
+    for (auto& [h, retry] : parking) _parked[h].push_back(move(retry));
+    resume_parked();
+
+    auto stalled = move(_stalled);
+    _stalled.clear();
+    for (auto id : stalled) {
+      on_connection(id, [this, id](connection& c) {
+        c.stalled = false;
+        decode(id, c);
+        send(c);
+      });
+    }
   }
-}
+
+public:
+
+  reactor(tcp_acceptor&& acc, looper& l, handlers_map_t&& handlers)
+    : _l(l), _handlers(move(handlers)), _acc(move(acc)),
+        _epoll(::epoll_create1(EPOLL_CLOEXEC)),
+        _wake(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+        _pool(max_workers_count(), max_queued_tasks, [this]() { wake(); }),
+        _next_id(wake_key + 1), _parked_count(0) {
+    if (_epoll < 0 || _wake < 0)
+      throw system_error(errno, generic_category(), "Server reactor");
+
+    _acc.set_non_blocking();
+    watch(EPOLL_CTL_ADD, _acc.handle(), acceptor_key, EPOLLIN);
+    watch(EPOLL_CTL_ADD, _wake, wake_key, EPOLLIN);
+  }
+
+  void run() {
+    logger()->info("Server reactor thread #{} begins! ({} workers)",
+      this_thread::get_id(), max_workers_count());
+
+    constexpr int max_events = 64;
+    epoll_event events[max_events];
+    for (;;) {
+      auto n = ::epoll_wait(_epoll, events, max_events,
+        _parked.empty() ? -1 : int(parked_poll.count()));
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        logger()->critical("Server reactor failed: {}", strerror(errno));
+        return;
+      }
+
+      for (int i = 0; i < n; ++i) {
+        auto& ev = events[i];
+        if (ev.data.u64 == acceptor_key) accept();
+        else if (ev.data.u64 == wake_key) drain();
+        else on_connection(ev.data.u64, [this, &ev](connection& c) {
+          if (ev.events & (EPOLLERR | EPOLLHUP))
+            throw io::transfer_error("Connection is broken.");
+          if (ev.events & EPOLLIN) receive(ev.data.u64, c);
+          send(c);
+        });
+      }
+      // Handlers of parked requests are checked on every poll.
+      if (!_parked.empty()) drain();
+    }
+  }
+
+};
 
 } // namespace
 
@@ -179,8 +670,14 @@ void start(in_port_t port, handlers_map_t&& handlers) {
   tcp_acceptor acc(port);
   if (!acc) throw io::transfer_error(acc);
 
-  std::thread(&server_thread, move(acc), std::ref(looper::current()),
-    move(handlers)).detach();
+  // The reactor serves for as long as the process runs.
+  auto r = make_unique<reactor>(move(acc), looper::current(),
+    move(handlers));
+  std::thread(&reactor::run, r.release()).detach();
+}
+
+counters stats() {
+  return {connections_count_, requests_count_, tasks_count_};
 }
 
 } // namespace server
@@ -3,6 +3,7 @@
 #include "sockpp/platform.h"
 
 #include <functional>
+#include <future>
 #include <map>
 #include <memory>
 
@@ -44,21 +45,40 @@ private:
 
 };
 
-using handlers_map_t = std::map<
-  pb::message_id_t,
-  std::function<void(const request_resources&, response_sink&)>
->;
+// A request is parked until the handler is ready (if `ready` is set),
+// so that neither the looper nor the server's workers wait for it.
+struct handler_entry final {
+
+  std::function<void(const request_resources&, response_sink&)> callback;
+  std::shared_future<void> ready;
+
+};
+
+using handlers_map_t = std::map<pb::message_id_t, handler_entry>;
 
 template<typename M, typename H>
-handlers_map_t::value_type handler(H&& handler) {
-  return std::make_pair(pb::message_info<M>::message_id,
+handlers_map_t::value_type handler(H&& handler,
+    std::shared_future<void> ready = {}) {
+  return std::make_pair(pb::message_info<M>::message_id, handler_entry{
     [h = std::forward<H>(handler)](auto& res, auto& sink) {
       h(request<M>(res), sink);
-    });
+    },
+    std::move(ready)});
 }
 
 void start(in_port_t port, handlers_map_t&& handlers);
 
+// What the server is busy with at the moment.
+struct counters final {
+
+  size_t connections;
+  size_t requests_in_flight;
+  size_t tasks_queued;
+
+};
+
+counters stats();
+
 } // namespace server
 
 } // namespace marslander::trainer
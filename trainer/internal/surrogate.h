@@ -0,0 +1,133 @@
+#include "global_includes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace marslander::trainer {
+
+// Ridge regression of a genome score over its genes (plus an intercept),
+// fitted on all (genome, score) pairs observed so far. Only the normal
+// equations are accumulated, so the history costs O(d^2) memory.
+class surrogate_model final {
+
+  size_t _dims, _observed;
+  std::vector<double> _xtx, _xty, _w;
+  bool _fitted;
+
+  // Solves a x = b for a symmetric positive definite `a` in place.
+  static bool cholesky_solve(size_t n, std::vector<double>& a,
+      std::vector<double>& b) {
+    for (size_t j = 0; j < n; ++j) {
+      auto d = a[j * n + j];
+      for (size_t k = 0; k < j; ++k) d -= a[j * n + k] * a[j * n + k];
+      if (!(d > 0)) return false;
+      a[j * n + j] = std::sqrt(d);
+
+      for (size_t i = j + 1; i < n; ++i) {
+        auto v = a[i * n + j];
+        for (size_t k = 0; k < j; ++k) v -= a[i * n + k] * a[j * n + k];
+        a[i * n + j] = v / a[j * n + j];
+      }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t k = 0; k < i; ++k) b[i] -= a[i * n + k] * b[k];
+      b[i] /= a[i * n + i];
+    }
+    for (size_t i = n; i-- > 0;) {
+      for (size_t k = i + 1; k < n; ++k) b[i] -= a[k * n + i] * b[k];
+      b[i] /= a[i * n + i];
+    }
+
+    return true;
+  }
+
+public:
+
+  surrogate_model() : _dims{}, _observed{}, _fitted{} {}
+
+  size_t observed() const noexcept { return _observed; }
+  bool fitted() const noexcept { return _fitted; }
+
+  void clear() {
+    _dims = _observed = 0;
+    _xtx.clear(); _xty.clear(); _w.clear();
+    _fitted = false;
+  }
+
+  void observe(const pb::genome& g, double score) {
+    auto& genes = g.genes();
+    auto n = size_t(genes.size()) + 1;
+    if (n != _dims) {
+      clear();
+      _dims = n;
+      _xtx.assign(n * n, 0.);
+      _xty.assign(n, 0.);
+    }
+
+    auto x = [&genes, n](size_t i) { return i + 1 < n ? genes[int(i)] : 1.; };
+    for (size_t i = 0; i < n; ++i) {
+      auto xi = x(i);
+      for (size_t j = 0; j <= i; ++j) _xtx[i * n + j] += xi * x(j);
+      _xty[i] += xi * score;
+    }
+    ++_observed;
+  }
+
+  // The intercept is not penalized.
+  bool fit(double lambda) {
+    _fitted = false;
+    if (_observed <= _dims) return false;
+
+    auto n = _dims;
+    auto a = _xtx;
+    for (size_t i = 0; i < n; ++i)
+    for (size_t j = 0; j < i; ++j)
+      a[j * n + i] = a[i * n + j];
+    for (size_t i = 0; i + 1 < n; ++i) a[i * n + i] += lambda;
+
+    auto b = _xty;
+    if (!cholesky_solve(n, a, b)) return false;
+
+    _w = std::move(b);
+    _fitted = true;
+    return true;
+  }
+
+  double predict(const pb::genome& g) const {
+    auto& genes = g.genes();
+    if (!_fitted || size_t(genes.size()) + 1 != _dims)
+      return std::numeric_limits<double>::quiet_NaN();
+
+    return std::inner_product(genes.begin(), genes.end(), _w.begin(),
+      _w.back());
+  }
+
+};
+
+// Spearman's rank correlation of paired values (ties ranked arbitrarily).
+template<typename T>
+double rank_correlation(const std::vector<T>& x, const std::vector<T>& y) {
+  auto n = std::min(x.size(), y.size());
+  if (n < 2) return std::numeric_limits<double>::quiet_NaN();
+
+  auto ranks = [n](const std::vector<T>& v) {
+    std::vector<size_t> inds(n);
+    std::iota(inds.begin(), inds.end(), 0);
+    std::sort(inds.begin(), inds.end(),
+      [&v](auto a, auto b) { return v[a] < v[b]; });
+    std::vector<double> r(n);
+    for (size_t i = 0; i < n; ++i) r[inds[i]] = double(i);
+    return r;
+  };
+
+  auto rx = ranks(x), ry = ranks(y);
+  double d2 = 0;
+  for (size_t i = 0; i < n; ++i) d2 += (rx[i] - ry[i]) * (rx[i] - ry[i]);
+  return 1. - 6. * d2 / (double(n) * (double(n) * n - 1.));
+}
+
+} // namespace marslander::trainer
@@ -18,9 +18,16 @@ void app::run() {
   l.run();
 }
 
-app_state& app::state() {
-  if (_state_future.valid())
-    _state_future.get();
+std::shared_future<void> app::ready(stage st) const {
+  if (st == stage::cases && _cases_ready.valid()) return _cases_ready;
+  if (st != stage::results && _population_ready.valid())
+    return _population_ready;
+  return _state_future;
+}
+
+app_state& app::state(stage st) {
+  if (auto f = ready(st); f.valid())
+    f.get();
 
   return _state;
 }
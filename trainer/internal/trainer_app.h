@@ -1,17 +1,36 @@
+#pragma once
+
+#ifndef TRAINER_INTERNAL_TRAINER_APP_H_
+#define TRAINER_INTERNAL_TRAINER_APP_H_
+
 #include "internal/concurrent_random_engine.h"
+#include "internal/fitness_cache.h"
 #include "internal/ga.h"
+#include "internal/history.h"
+#include "internal/id_directory.h"
+#include "internal/island.h"
+#include "internal/lease_dispatcher.h"
+#include "internal/mapped_file.h"
+#include "internal/optimizer.h"
 #include "internal/results_table.h"
+#include "internal/selection.h"
 #include "internal/server.h"
+#include "internal/surrogate.h"
 #include "global_includes.h"
 
 #include "sockpp/platform.h"
 
+#include <deque>
 #include <filesystem>
+#include <fstream>
 #include <future>
-#include <map>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <ostream>
 #include <random>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace marslander::trainer {
@@ -32,41 +51,56 @@ struct app_args final {
 
   std::filesystem::path directory;
 
-  void parse_replay_optarg(const std::string& optarg,
-    const std::string& delim);
-};
+  size_t fitness_cache_size;
+  bool parse_fitness_cache_optarg(const std::string& optarg);
 
-struct algorithm_args final {
-  using value_type = double;
+  int steady_state_flag;
+  size_t steady_state_persist_cadence;
+  bool parse_steady_state_optarg(const std::string& optarg);
 
-  std::string name;
-  std::vector<value_type> values;
-};
+  island::peers_t island_peers;
+  // Tells migrants of this island apart; random unless given.
+  std::string island_id;
+  size_t migration_interval, migration_size;
+
+  size_t racing_min_cases;
+  double racing_keep;
+  bool parse_racing_optarg(const std::string& optarg);
+
+  double surrogate_factor, surrogate_lambda;
+  bool parse_surrogate_optarg(const std::string& optarg);
 
-template<typename T>
-struct index_entry {
+  size_t speculation_threshold, speculation_copies;
+  bool parse_speculation_optarg(const std::string& optarg);
 
-  using ind_t = typename std::vector<T>::size_type;
-  using ref_t = typename std::vector<T>::reference;
+  size_t work_unit_ms;
+  bool parse_work_unit_optarg(const std::string& optarg);
 
-  index_entry(ind_t index, ref_t element)
-    : _index{index},
-      _elem{element}
-    {}
+  size_t coarse_cases;
+  double coarse_keep;
+  bool parse_coarse_optarg(const std::string& optarg);
 
-  index_entry(const index_entry& ) = default;
-  index_entry(      index_entry&&) = default;
+  std::filesystem::path sweep_path;
 
-  ind_t index() const { return _index; }
-  operator ind_t() const { return _index; }
+  size_t checkpoint_interval;
+  bool parse_checkpoint_optarg(const std::string& optarg);
 
-  ref_t operator*() {return _elem; }
+  int history_flag;
+  std::filesystem::path history_path;
 
-private:
+  bool parse_island_optarg(const std::string& optarg,
+    const std::string& delim);
+  bool parse_migration_optarg(const std::string& optarg);
+
+  void parse_replay_optarg(const std::string& optarg,
+    const std::string& delim);
+};
 
-  const ind_t _index;
-  const ref_t _elem;
+struct algorithm_args final {
+  using value_type = double;
 
+  std::string name;
+  std::vector<value_type> values;
 };
 
 struct app_state final {
@@ -86,6 +120,12 @@ struct app_state final {
   using population_t = std::vector<pb::genome>;
   population_t population;
 
+  // Optional trailer; files written without it are GA sessions.
+  algorithm_args optimizer{"ga", {}};
+  optimizer_algo::state_t optimizer_state;
+  // Missing in files written before; tournament_size-way tournament then.
+  algorithm_args selection{"tournament", {1.}};
+
   // Add serialized data above this line
 
   using random_engine_t = concurrent_random_engine<std::mt19937_64, 4096>;
@@ -94,6 +134,9 @@ struct app_state final {
 
   std::unique_ptr<crossover_algo> pxvr;
   std::unique_ptr<mutation_algo> pmtn;
+  std::unique_ptr<selection_algo> psel;
+  // Replaces the GA generation step when set.
+  std::unique_ptr<optimizer_algo> popt;
 
   enum read_mode {
     header = 1,
@@ -104,18 +147,174 @@ struct app_state final {
   std::istream& read (std::istream&, read_mode = all);
   std::ostream& write(std::ostream&) const;
 
-  template<typename T>
-  using index_t = std::map<uid_t, index_entry<T>>;
-  index_t<pb::landing_case> cases_index;
-  index_t<pb::genome> population_index;
+  // Files are written in the indexed layout: a directory of the records
+  // follows the header. Files read may be of the plain one, where records
+  // can only be located one after another.
+  bool indexed_layout{};
+
+  // The body of a mapped training file (read past its header), parsed
+  // record by record on demand until it's unmapped into cases and
+  // population. Ids of the records are known upfront in the indexed
+  // layout only, as are the byte ranges of the cases and of the genomes
+  // along with their checksums, which are verified on unmapping; files of
+  // the plain layout are checked whole beforehand.
+  struct mapped_body {
+    struct section {
+      size_t from, to;
+      uint32_t checksum;
+    };
+
+    std::shared_ptr<const mapped_file> file;
+    record_view<pb::landing_case> cases;
+    record_view<pb::genome> population;
+    std::vector<uid_t> case_ids, genome_ids;
+    std::optional<section> cases_section, genomes_section;
+  } mapped;
+  bool map(std::shared_ptr<const mapped_file>, size_t offset);
+  bool mapped_intact() const;
+  bool unmap_cases();
+  bool unmap_population();
+  const pb::landing_case* find_case(uid_t) const;
+  const pb::genome* find_genome(uid_t) const;
+
+  // Checkpoint log: between full writes (every `interval` saves) a save
+  // appends a record of the genomes issued since the last one along with
+  // the ids of the population; recovery replays the valid records.
+  struct journal_state {
+    size_t interval, records;
+    uid_t uid;
+  } journal{};
+  std::ostream& write_checkpoint(std::ostream&) const;
+  size_t replay_checkpoints(std::istream&);
+
+  // Resolve ids to positions in cases and population respectively.
+  id_directory cases_index, population_index;
   void rebuild_indices();
 
-  size_t index;
-  using timeout_clock_t = std::chrono::steady_clock;
-  std::vector<timeout_clock_t::time_point> timeouts;
+  lease_dispatcher dispatcher;
   results_table results;
   void reset_results();
 
+  // Exact ratings of the current generation are appended to a log of the
+  // generation as they come in, so that a restart resumes the generation
+  // rather than simulating all of it over again.
+  struct rating_record {
+    uid_t genome_id, case_id;
+    results_table::value_type rating;
+  };
+  struct ratings_log_state {
+    std::ofstream file;
+    size_t generation;
+  } ratings_log{};
+
+  // The window of cases a genome is due to run (all of them, or a racing
+  // stage) is split into units_per_genome blocks, each one a separate work
+  // unit; unit u stands for block u % units_per_genome of genome
+  // u / units_per_genome, sized after the measured runner throughput.
+  lease_dispatcher::duration unit_time;
+  size_t units_per_genome;
+  void reset_units();
+  void ready_units(size_t i);
+  void complete_units(size_t i);
+  std::pair<size_t, size_t> unit_block(size_t u) const;
+  size_t unit_of(size_t i, size_t case_ind) const;
+  bool unit_rated(size_t u);
+
+  // Keys of the genes by individual: children get theirs as they're bred,
+  // populations loaded or generated are hashed whole by hash_genes().
+  std::vector<fitness_cache::key_type> genes_keys;
+  void hash_genes();
+  fitness_cache cache;
+  size_t cache_hits;
+  void cache_results();
+
+  // Steady-state mode keeps an evaluated pool of population_size
+  // individuals followed by the offspring currently being evaluated.
+  size_t evaluations;
+  std::vector<score_t> scores;
+  // Parents are drawn from the pool by a tournament over scores.
+  std::unique_ptr<selection_algo> pool_sel;
+  pb::genome offspring_spare;
+  bool steady_state() const { return population.size() > population_size; }
+
+  // Generation rollover is computed off the looper into the back buffer,
+  // while requests of the closing generation are still served from the
+  // front one; the two are swapped once it's done.
+  struct rollover_buffer {
+    population_t population;
+    std::vector<fitness_cache::key_type> genes_keys;
+    size_t generation;
+    bool pending;
+    std::future<void> task;
+    // Saving of the last generation bred.
+    std::future<void> persist;
+  } rollover{};
+  bool rolling_over() const { return rollover.pending; }
+
+  // Genomes received from other islands, awaiting a place in population.
+  std::deque<pb::genome> immigrants;
+
+  // Successive-halving racing: stage k evaluates the alive genomes on
+  // cases [stage_begin; stage_end) of a window starting at offset, then
+  // the bottom of them are culled, i.e. rated as the worst and dropped.
+  struct race_state {
+    size_t min_cases;
+    double keep;
+    size_t offset, stage_begin, stage_end;
+    std::vector<bool> culled;
+    size_t culled_count, simulations_saved;
+  } race;
+  bool racing() const {
+    return race.min_cases > 0 && race.min_cases < cases.size()
+      && !steady_state() && !multi_fidelity();
+  }
+  void begin_race();
+  bool advance_race();
+
+  // Multi-fidelity: every genome is rated on the first `cases` of the
+  // window at coarse fidelity (held controls) first; only the best `keep`
+  // fraction of them go on to exact evaluation of all the cases, the rest
+  // are culled as in racing. Genomes rated exactly already (cache hits)
+  // skip it.
+  struct fidelity_state {
+    size_t cases;
+    double keep;
+    enum phase_t { off, coarse, exact, done } phase;
+    results_table results;
+    std::vector<bool> exact_rated;
+    std::vector<score_t> scores;
+    size_t promoted;
+    double rank_corr;
+  } fidelity;
+  bool multi_fidelity() const {
+    return fidelity.cases > 0 && fidelity.cases < cases.size()
+      && !steady_state();
+  }
+  bool coarse() const { return fidelity.phase == fidelity_state::coarse; }
+  void begin_fidelity();
+  bool advance_fidelity();
+
+  // Surrogate pre-screening: GA breeds surrogate_factor times as many
+  // children as needed and keeps the ones with the best predicted score.
+  surrogate_model surrogate;
+  double surrogate_factor, surrogate_lambda;
+  std::vector<score_t> predictions;
+  bool screening() const { return surrogate_factor > 1 && surrogate.fitted(); }
+  double observe_scores(const std::vector<score_t>&);
+  void screen_offspring(population_t&, size_t from, size_t count);
+
+  // At the end of a generation, once no more than speculation_threshold
+  // genomes are unfinished, idle runners get extra copies of them (up to
+  // speculation_copies each); the first rating of a cell wins.
+  size_t speculation_threshold, speculation_copies;
+  std::vector<uint8_t> copies;
+  size_t ratings_discarded;
+
+  // Hyperparameter sweep: session 0 is the main one, others are persisted
+  // aside; runners are shared in proportion to simulations leased.
+  size_t session{}, simulations_leased{};
+  score_t best_score = std::numeric_limits<score_t>::infinity();
+
 };
 
 #define REQUEST_HANDLER_MEM_DECL_(msg)\
@@ -125,19 +324,53 @@ struct app_state final {
 class app final {
 
   static constexpr char training_filename[] = "training.dat";
+  static constexpr char journal_filename[] = "training.log";
+  static constexpr char ratings_filename[] = "training.ratings";
   static logger_ptr _logger;
 
   const app_args _args;
 
   app_state _state;
-  std::future<void> _state_future;
-  app_state& state();
 
-  static std::ifstream& check_integrity(std::ifstream&);
+  // A training file is loaded in stages: cases, then population, then
+  // the rest of the state (results). Handlers get requests once the stage
+  // they need is reached; state() waits for it.
+  enum class stage { cases, population, results };
+  std::promise<void> _cases_loaded, _population_loaded;
+  std::shared_future<void> _cases_ready, _population_ready, _state_future;
+  std::shared_future<void> ready(stage) const;
+  app_state& state(stage = stage::results);
+
+  static bool check_integrity(const mapped_file&);
 
   static void on_generation_changed(app_state&);
 
-  static void persist_state(const app_state&);
+  // Sessions of a hyperparameter sweep besides the main one.
+  std::vector<std::unique_ptr<app_state>> _sweep;
+  void do_init_sweep();
+  app_state& session_of(uid_t genome_id);
+  std::vector<app_state*> sessions_by_share();
+  void report_sweep(app_state&, score_t best);
+
+  static void begin_steady_state(app_state&);
+  static void replace_worst(app_state&, size_t j);
+  std::future<void> on_steady_state_outcomes(app_state&);
+
+  // Columnar archive of generations, see generation_history.
+  std::future<void> _history_write;
+  static void append_history(const std::filesystem::path&,
+    const generation_history&);
+
+  std::future<void> _emigration;
+  bool is_migration_due(const app_state&) const;
+  void emigrate(const app_state&, app_state::population_t&&);
+  static void settle_immigrants(app_state&);
+
+  static void persist_state(app_state&, const std::filesystem::path&);
+  static void log_ratings(app_state&, const std::filesystem::path&,
+    const std::vector<app_state::rating_record>&);
+  static size_t restore_ratings(app_state&, const std::filesystem::path&);
+  static bool restore_session(app_state&, const std::filesystem::path&);
 
   std::filesystem::path get_data_path() const;
   std::filesystem::path get_data_path(
@@ -145,7 +378,7 @@ class app final {
 
   void do_init();
 
-  void do_init_from_file(std::ifstream&&);
+  void do_init_from_file(std::shared_ptr<const mapped_file>);
 
   void do_init_from_scratch();
 
@@ -155,9 +388,19 @@ class app final {
 
   void on_server_initialized();
 
+  // Outcomes received before the results table is reset; they're taken
+  // in with the first request after.
+  std::vector<pb::outcomes> _early_outcomes;
+  std::future<void> take_outcomes(const pb::outcomes*);
+
   // Request handlers follow
   void REQUEST_HANDLER_MEM_DECL_(cases);
   void REQUEST_HANDLER_MEM_DECL_(outcomes);
+  void REQUEST_HANDLER_MEM_DECL_(migrants);
+  void REQUEST_HANDLER_MEM_DECL_(heartbeat);
+
+  // Drives parts of the app in tests, without running it.
+  friend struct app_tests;
 
 public:
 
@@ -173,3 +416,5 @@ public:
 };
 
 } // namespace marslander::trainer
+
+#endif // TRAINER_INTERNAL_TRAINER_APP_H_
@@ -0,0 +1,135 @@
+#include "trainer_app.h"
+#include "trainer_input.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <string>
+
+namespace marslander::trainer {
+
+using namespace std;
+
+bool app_args::parse_coarse_optarg(const string& optarg) {
+  using namespace marslander::input;
+  constexpr auto ul_max_ = numeric_limits<unsigned long>::max();
+
+  auto tokens = split(optarg, string(";"), true);
+  if (tokens.empty() || tokens.size() > 2) return false;
+
+  unsigned long cases;
+  double keep = coarse_keep;
+  if (!cvt_num_ul(tokens[0], cases, 0, ul_max_, 0)) return false;
+  if (tokens.size() > 1 && !cvt_num_dbl(tokens[1], keep, 0, 1, keep))
+    return false;
+  if (keep <= 0 || keep >= 1) return false;
+
+  coarse_cases = cases;
+  coarse_keep = keep;
+  return true;
+}
+
+void app_state::begin_fidelity() {
+  constexpr auto nan_ = numeric_limits<score_t>::quiet_NaN();
+  fidelity.promoted = 0;
+  fidelity.rank_corr = nan_;
+  fidelity.phase = fidelity_state::off;
+  if (!multi_fidelity()) return;
+
+  fidelity.phase = fidelity_state::coarse;
+  fidelity.results.resize(cases.size(), population.size(),
+    numeric_limits<results_table::value_type>::quiet_NaN());
+  fidelity.scores.assign(population.size(), nan_);
+  fidelity.exact_rated.assign(population.size(), false);
+  for (auto&& [i, row_from, row_to] : results) {
+    fidelity.exact_rated[i] = none_of(row_from, row_to, pred_std_isnan);
+  }
+
+  uniform_int_distribution<size_t> d{0, cases.size() - 1};
+  race.offset = d(*prng);
+  race.stage_begin = 0;
+  race.stage_end = fidelity.cases;
+}
+
+// Moves on to the exact phase once every genome has its coarse rating,
+// and completes the culled rows once the promoted genomes are rated
+// exactly; returns true on a change of phase.
+bool app_state::advance_fidelity() {
+  auto n = cases.size();
+  auto pop_size = population.size();
+
+  if (fidelity.phase == fidelity_state::coarse) {
+    vector<score_t> score(pop_size);
+    for (size_t i = 0; i < pop_size; ++i) {
+      if (fidelity.exact_rated[i]) {
+        score[i] = -numeric_limits<score_t>::infinity();
+        continue;
+      }
+
+      auto row = fidelity.results[i];
+      score_t sum{};
+      for (size_t k = 0; k < fidelity.cases; ++k) {
+        auto v = row[(race.offset + k) % n];
+        if (std::isnan(v)) return false;
+        sum += v;
+      }
+      score[i] = fidelity.scores[i] = sum / fidelity.cases;
+    }
+
+    auto keep_count = min(pop_size, max<size_t>({
+      size_t(ceil(pop_size * fidelity.keep)),
+      min(elite_count, pop_size),
+      1}));
+
+    vector<size_t> inds(pop_size);
+    iota(inds.begin(), inds.end(), 0);
+    nth_element(inds.begin(), next(inds.begin(), keep_count), inds.end(),
+      [&score](auto u, auto v) { return score[u] < score[v]; });
+    for (auto it = next(inds.begin(), keep_count); it != inds.end(); ++it) {
+      race.culled[*it] = true;
+      ++race.culled_count;
+    }
+
+    fidelity.promoted = keep_count;
+    fidelity.phase = fidelity_state::exact;
+    race.stage_begin = 0;
+    race.stage_end = n;
+    reset_units();
+    return true;
+  }
+
+  if (fidelity.phase == fidelity_state::exact) {
+    vector<score_t> coarse_score, exact_score;
+    for (auto&& [i, row_from, row_to] : results) {
+      if (race.culled[i]) continue;
+      if (any_of(row_from, row_to, pred_std_isnan)) return false;
+      if (fidelity.exact_rated[i]) continue;
+
+      coarse_score.push_back(fidelity.scores[i]);
+      exact_score.push_back(accumulate(row_from, row_to, score_t{}) / n);
+    }
+    fidelity.rank_corr = rank_correlation(coarse_score, exact_score);
+
+    auto worst = numeric_limits<results_table::value_type>::lowest();
+    for (auto&& [i, row_from, row_to] : results)
+      if (!race.culled[i]) worst = max(worst, *max_element(row_from, row_to));
+
+    for (auto&& [i, row_from, row_to] : results) {
+      if (!race.culled[i]) continue;
+      for (auto it = row_from; it != row_to; ++it) {
+        if (!std::isnan(*it)) continue;
+        *it = worst;
+        ++race.simulations_saved;
+      }
+    }
+
+    fidelity.phase = fidelity_state::done;
+    return true;
+  }
+
+  return false;
+}
+
+} // namespace marslander::trainer
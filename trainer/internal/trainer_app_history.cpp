@@ -0,0 +1,18 @@
+#include "trainer_app.h"
+
+#include <filesystem>
+
+namespace marslander::trainer {
+
+using namespace std;
+
+// Runs off the looper.
+void app::append_history(const filesystem::path& path,
+    const generation_history& h) {
+  if (!history::append(path, h)) {
+    SPDLOG_LOGGER_WARN(_logger, "Failed to append generation #{} to "
+      "history archive {}.", h.generation, path);
+  }
+}
+
+} // namespace marslander::trainer
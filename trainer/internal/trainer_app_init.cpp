@@ -2,12 +2,16 @@
 #include "trainer_input.h"
 #include "internal/trainer_data.h"
 
+#include "crc32.h"
+
 #include <chrono>
 #include <exception>
+#include <filesystem>
 #include <future>
 #include <limits>
 #include <random>
 #include <string>
+#include <system_error>
 #include <thread>
 
 namespace marslander::trainer {
@@ -15,16 +19,41 @@ namespace marslander::trainer {
 using namespace std;
 using namespace nlohmann;
 
+bool app_args::parse_fitness_cache_optarg(const string& optarg) {
+  using namespace marslander::input;
+  constexpr auto ul_max_ = numeric_limits<unsigned long>::max();
+
+  unsigned long entries;
+  if (!cvt_num_ul(optarg, entries, 0, ul_max_, fitness_cache_size))
+    return false;
+
+  fitness_cache_size = entries;
+  return true;
+}
+
 void app::do_init() {
 
   bool will_export = _args.export_dump_session_flag
     || _args.export_replay_flag;
 
+  _state.cache.resize(_args.fitness_cache_size);
+  _state.race.min_cases = _args.racing_min_cases;
+  _state.race.keep = _args.racing_keep;
+  _state.fidelity.cases = _args.coarse_cases;
+  _state.fidelity.keep = _args.coarse_keep;
+  _state.surrogate_factor = _args.surrogate_factor;
+  _state.surrogate_lambda = _args.surrogate_lambda;
+  _state.speculation_threshold = _args.speculation_threshold;
+  _state.speculation_copies = _args.speculation_copies;
+  _state.unit_time = chrono::milliseconds(_args.work_unit_ms);
+  _state.journal.interval = _args.checkpoint_interval;
+
   bool init_from_scratch = _args.init_flag;
   {
-    ifstream training(get_data_path(training_filename), ios::binary);
+    auto training = make_shared<const mapped_file>(
+      get_data_path(training_filename));
 
-    if (training) {
+    if (*training) {
       if (init_from_scratch) {
         cout << "There's a '" << training_filename 
                 << "' file found in the working directory!\n"
@@ -60,6 +89,7 @@ void app::do_init() {
     if (!_args.no_exit_flag) exit(_last_error);
   }
 
+  do_init_sweep();
   on_server_initialized();
 }
 
@@ -76,7 +106,9 @@ string state_digest(const app_state& s) {
 " elite count:     {}\n"
 " tournament size: {}\n"
 " crossover:       {}\n"
-" mutation:        {}",
+" mutation:        {}\n"
+" selection:       {}\n"
+" optimizer:       {}",
     s.check,
     s.generation,
     s.cases_count,
@@ -84,7 +116,9 @@ string state_digest(const app_state& s) {
     s.elite_count,
     s.tournament_size,
     s.crossover,
-    s.mutation);
+    s.mutation,
+    s.selection,
+    s.optimizer);
 }
 
 } // namespace
@@ -103,17 +137,40 @@ basic_ostream<CharT, Traits>& operator<<(basic_ostream<CharT, Traits>& dst,
   return dst;
 }
 
-void app::do_init_from_file(ifstream&& training) {
+void app::do_init_from_file(shared_ptr<const mapped_file> training) {
 
-  if (!check_integrity(training)) {
+  auto corrupted = []() {
     cerr << training_filename << " is corrupted." << endl;
     exit(-3);
-  }
+  };
+  if (!check_integrity(*training)) corrupted();
 
   auto& s = _state;
-  training.exceptions(ios_base::badbit | ios_base::failbit);
-  s.read(training, app_state::header);
-  training.exceptions(ios_base::goodbit);
+  mapped_buf buf(*training);
+  istream is(&buf);
+  is.seekg(sizeof(checksum::crc32_t));
+  is.exceptions(ios_base::badbit | ios_base::failbit);
+  s.read(is, app_state::header);
+  is.exceptions(ios_base::goodbit);
+
+  if (!s.map(move(training), size_t(is.tellg()))) corrupted();
+
+  // Exports read the mapped records as they go and needn't load the
+  // session: a replay needs just a couple of records, which the indexed
+  // layout finds without parsing the rest, and a dump parses one record
+  // at a time. Checkpoints appended to the log would have to be replayed
+  // though.
+  error_code ec;
+  auto journal_size = filesystem::file_size(
+    get_data_path(journal_filename), ec);
+  if ((_args.export_replay_flag || _args.export_dump_session_flag)
+      && !_args.no_exit_flag
+      && (s.indexed_layout || !_args.export_replay_flag)
+      && (ec || journal_size <= 0)) {
+    if (!s.mapped_intact()) corrupted();
+    _state_future = async(launch::deferred, []() {});
+    return;
+  }
 
   if (!xvr_factory().instantiate(s.crossover, s.prng, s.pxvr)){
     cerr << quoted(s.crossover.name, '\'') 
@@ -132,37 +189,84 @@ void app::do_init_from_file(ifstream&& training) {
     exit(-3);
   }
 
+  _cases_ready = _cases_loaded.get_future().share();
+  _population_ready = _population_loaded.get_future().share();
   _state_future = async(launch::async,
     [
+      this,
       &s,
-      is = move(training)
+      corrupted,
+      journal_path = get_data_path(journal_filename),
+      directory = get_data_path()
     ]
     () mutable {
-      s.read(is, app_state::body);
+      try {
+        if (!s.unmap_cases()) corrupted();
+        _cases_loaded.set_value();
+
+        if (!s.unmap_population()) corrupted();
+        if (ifstream journal{journal_path, ios::binary}) {
+          if (auto n = s.replay_checkpoints(journal))
+            cout << "Replayed " << n << " checkpoint(s) of "
+              << journal_filename << ".\n";
+        }
+        else {
+          s.journal.uid = s.uids.value();
+        }
+
+        if (!opt_factory().instantiate(s.optimizer, s.prng, s.popt)
+            || s.popt && !s.popt->load(s.optimizer_state)) {
+          cerr << quoted(s.optimizer.name, '\'')
+            << " unrecognized optimizer or its state; "
+               "is it no longer supported?\n"
+            << s.optimizer << endl;
+
+          exit(-3);
+        }
+        s.optimizer_state.clear();
+
+        if (!sel_factory().instantiate(s.selection, s.prng, s.psel)) {
+          cerr << quoted(s.selection.name, '\'')
+            << " unrecognized selection algorithm; "
+               "is it no longer supported?\n"
+            << s.selection << endl;
+
+          exit(-3);
+        }
+
+        s.rebuild_indices();
+        cout << "Recovered training state!\n"
+          << state_digest(s) << endl;
+        _population_loaded.set_value();
 
-      cout << "Recovered training state!\n"
-        << state_digest(s) << endl;
-      on_generation_changed(s);
+        s.hash_genes();
+        s.reset_results();
+        if (auto n = restore_ratings(s, directory))
+          cout << "Restored " << n << " rating(s) of generation #"
+            << s.generation << ".\n";
+      }
+      catch (...) {
+        // Waiters of a stage not reached yet get the failure as well.
+        for (auto p : {&_cases_loaded, &_population_loaded}) {
+          try { p->set_exception(current_exception()); }
+          catch (const future_error&) {}
+        }
+        throw;
+      }
     });
 }
 
 namespace {
 
-using predefined_cases_t = vector<data::landing_case>;
-inline predefined_cases_t read_cases_file(
-    const filesystem::path& path) {
-
-  json j = json::parse(ifstream{path});
-  return j.get<vector<data::landing_case>>();
-}
+using predefined_cases_t = vector<pb::landing_case>;
 
 inline auto read_cases_file_async(const filesystem::path& path) {
   if (path.empty()) {
     return async(launch::deferred,
-      []() { return vector<data::landing_case>(); });
+      []() { return predefined_cases_t(); });
   }
 
-  return async(launch::async, read_cases_file, path);
+  return async(launch::async, data::import_cases, path);
 }
 
 constexpr auto dbl_max_ = numeric_limits<double>::max();
@@ -170,12 +274,16 @@ constexpr auto ul_max_ = numeric_limits<unsigned long>::max();
 
 template<class Factory, class PRNG>
 static void read_algo(string title, algorithm_args& in_out_args, PRNG prng,
-    typename Factory::result_type& result) {
+    typename Factory::result_type& result, bool empty_is_default = false) {
   using namespace marslander::input;
   for(Factory f;;) {
     read_input(title,
       "Enter <alg name>[; <value>[; <value>]]",
-      &cvt_alg_args, in_out_args);
+      [empty_is_default](const string& str, algorithm_args& r) {
+        return cvt_alg_args(
+          str.empty() && empty_is_default ? string("default") : str, r);
+      },
+      in_out_args);
 
     typename Factory::errors_t errors;
     if (f.validate_args(in_out_args, errors)) {
@@ -197,6 +305,24 @@ void setup_population(app_state& s) {
     "Enter a positive number greater than or equal 1.",
     bind(&cvt_num_ul, _1, _2, 1, ul_max_, 1), s.population_size);
 
+  read_algo<opt_factory>("Optimizer [ga]:", s.optimizer, s.prng, s.popt, true);
+  if (s.popt) {
+    // A distribution-based optimizer breeds the whole population itself;
+    // GA settings are kept valid for the state file only.
+    s.elite_count = 0;
+    s.tournament_size = 1;
+    s.crossover = algorithm_args{"default", {}};
+    s.mutation = algorithm_args{"disabled", {}};
+    s.selection = algorithm_args{"tournament", {1.}};
+    basic_factory::errors_t errors;
+    xvr_factory().validate_args(s.crossover, errors);
+    mtn_factory().validate_args(s.mutation, errors);
+    xvr_factory().instantiate(s.crossover, s.prng, s.pxvr);
+    mtn_factory().instantiate(s.mutation, s.prng, s.pmtn);
+    sel_factory().instantiate(s.selection, s.prng, s.psel);
+    return;
+  }
+
   for(;;) {
     unit_value elite_units{};
     read_input(
@@ -220,9 +346,13 @@ void setup_population(app_state& s) {
   }
 
   bool has_crossover = true;
+  s.tournament_size = 1;
   auto tournament_size_max = s.population_size - s.elite_count;
   if (tournament_size_max > 1) {
-    read_input("Selection tournament size [1]:",
+    read_algo<sel_factory>("Selection [tournament]:",
+      s.selection, s.prng, s.psel, true);
+    if (s.selection.name == "tournament") read_input(
+      "Selection tournament size [1]:",
       fmt::format("Enter a number in range [1; {}].", tournament_size_max),
       bind(&cvt_num_ul, _1, _2, 1, tournament_size_max, 1), s.tournament_size);
   }
@@ -235,6 +365,11 @@ void setup_population(app_state& s) {
     has_crossover = false;
   }
 
+  if (s.selection.name == "tournament") {
+    s.selection.values = {double(s.tournament_size)};
+    sel_factory().instantiate(s.selection, s.prng, s.psel);
+  }
+
   if (has_crossover) read_algo<xvr_factory>("Crossover:",
     s.crossover, s.prng, s.pxvr);
   else s.crossover = algorithm_args{};
@@ -291,7 +426,8 @@ void app::do_init_from_scratch() {
     [
       &s,
       sway,
-      predefined_cases = move(predefined_cases)
+      predefined_cases = move(predefined_cases),
+      directory = get_data_path()
     ]
     () mutable {
       auto population_task = async(launch::async,
@@ -313,7 +449,7 @@ void app::do_init_from_scratch() {
       ITERZ_(predefined_cases, src);
       while(!ITERZ_END(dst) && !ITERZ_END(src)) {
         auto& item = *dst_it++;
-        data::convert(*src_it++, item);
+        item = move(*src_it++);
         item.set_id(s.uids.next_uid());
       }
 
@@ -330,13 +466,173 @@ void app::do_init_from_scratch() {
       {
         [[maybe_unused]]
         auto _ = async(launch::async,
-          [&s] () mutable { persist_state(s); });
+          [&s, &directory] () mutable { persist_state(s, directory); });
 
         cout << "Initialized training state!\n"
           << state_digest(s) << endl;
+        s.hash_genes();
         on_generation_changed(s);
       }
     });
 }
 
+namespace {
+
+// Session k of a sweep gets ids of its own, so that ratings coming back
+// can be told apart.
+constexpr uid_t sweep_uid_stride = uid_t(1) << 40;
+
+template<class Factory, class Result>
+bool setup_algo(const json& j, const char* key, algorithm_args& args,
+    shared_ptr<app_state::random_engine_t> prng, Result& result) {
+  if (j.contains(key)
+      && !input::cvt_alg_args(j.at(key).get<string>(), args))
+    return false;
+
+  Factory f;
+  typename Factory::errors_t errors;
+  if (!f.validate_args(args, errors)) {
+    for (auto& e : errors) cerr << args.name << ": " << e << endl;
+    return false;
+  }
+  return f.instantiate(args, prng, result);
+}
+
+// What's wrong with a configuration of the sweep file, if anything.
+string sweep_config_error(const json& j) {
+  if (!j.is_object()) return "it's not an object";
+  for (auto key : {"population", "elite", "tournament"}) {
+    if (j.contains(key) && !j.at(key).is_number_unsigned())
+      return fmt::format("'{}' is not a non-negative integer", key);
+  }
+  for (auto key : {"selection", "crossover", "mutation"}) {
+    if (j.contains(key) && !j.at(key).is_string())
+      return fmt::format("'{}' is not a string", key);
+  }
+  return {};
+}
+
+} // namespace
+
+// Every configuration of the sweep file (a JSON array of objects with
+// optional "population", "elite", "tournament", "selection", "crossover"
+// and "mutation" fields) becomes a GA session, resumed from its files or
+// else starting over from the population of the main one; cases are
+// shared. Configurations are checked right away, from the header of the
+// main session; sessions get their cases and population once it's loaded.
+void app::do_init_sweep() {
+  if (_args.sweep_path.empty()) return;
+
+  auto& base = _state;
+  json configs;
+  try { configs = json::parse(ifstream{_args.sweep_path}); }
+  catch (exception& e) {
+    cerr << "Bad sweep file " << _args.sweep_path << ": " << e.what() << endl;
+    exit(-2);
+  }
+  if (!configs.is_array()) {
+    cerr << "Bad sweep file " << _args.sweep_path
+      << ": an array of configurations is expected." << endl;
+    _last_error = -2;
+    exit(_last_error);
+  }
+
+  for (auto& j : configs) {
+    auto k = _sweep.size() + 1;
+    if (auto error = sweep_config_error(j); !error.empty()) {
+      cerr << "Sweep configuration #" << k << " is invalid: " << error
+        << "; " << j.dump() << endl;
+      _last_error = -2;
+      exit(_last_error);
+    }
+
+    auto ps = make_unique<app_state>();
+    auto& s = *ps;
+
+    s.check = base.check;
+    s.generation = 0;
+    s.cases_count = base.cases_count;
+    s.session = k;
+
+    s.population_size = j.value("population", base.population_size);
+    s.elite_count = j.value("elite", base.elite_count);
+    s.tournament_size = j.value("tournament", base.tournament_size);
+    s.crossover = base.crossover;
+    s.mutation = base.mutation;
+    s.selection = base.selection;
+    if (s.crossover.name.empty()) s.crossover = algorithm_args{"default", {}};
+    if (s.selection.name == "tournament")
+      s.selection.values = {double(s.tournament_size)};
+
+    bool valid = s.population_size > 0 && s.elite_count < s.population_size
+      && setup_algo<xvr_factory>(j, "crossover", s.crossover, s.prng, s.pxvr)
+      && setup_algo<mtn_factory>(j, "mutation", s.mutation, s.prng, s.pmtn)
+      && setup_algo<sel_factory>(j, "selection", s.selection, s.prng, s.psel);
+    // The selection given may set the tournament size, so it's checked last.
+    if (valid && s.selection.name == "tournament")
+      s.tournament_size = size_t(s.selection.values[0]);
+    valid = valid && s.tournament_size >= 1
+      && s.tournament_size <= s.population_size - s.elite_count;
+    if (!valid) {
+      cerr << "Sweep configuration #" << k << " is invalid: "
+        << j.dump() << endl;
+      _last_error = -2;
+      exit(_last_error);
+    }
+
+    s.cache.resize(_args.fitness_cache_size);
+    s.race.min_cases = _args.racing_min_cases;
+    s.race.keep = _args.racing_keep;
+    s.fidelity.cases = _args.coarse_cases;
+    s.fidelity.keep = _args.coarse_keep;
+    s.surrogate_factor = _args.surrogate_factor;
+    s.surrogate_lambda = _args.surrogate_lambda;
+    s.speculation_threshold = _args.speculation_threshold;
+    s.speculation_copies = _args.speculation_copies;
+    s.unit_time = base.unit_time;
+    s.journal.interval = _args.checkpoint_interval;
+
+    _sweep.push_back(move(ps));
+  }
+
+  // Runs off the looper, so that the server starts serving cases
+  // meanwhile; requests that need the sessions wait along with the rest
+  // of the state.
+  _state_future = async(launch::async,
+    [
+      this,
+      &base,
+      population = ready(stage::population),
+      rest = _state_future,
+      directory = get_data_path()
+    ]
+    () {
+      if (population.valid()) population.get();
+
+      for (auto& ps : _sweep) {
+        auto& s = *ps;
+        s.cases = base.cases;
+        s.uids = uid_source(base.uids.value() + s.session * sweep_uid_stride);
+
+        // Genomes past the size of the main population are mutated copies.
+        if (!restore_session(s, directory)) {
+          s.population.resize(s.population_size);
+          for (size_t i = 0; i < s.population_size; ++i) {
+            auto& item = s.population[i];
+            item = base.population[i % base.population.size()];
+            if (i >= base.population.size()) s.pmtn->exec(item);
+            item.set_id(s.uids.next_uid());
+          }
+        }
+
+        cout << "Sweep session #" << s.session << ":\n"
+          << state_digest(s) << endl;
+        s.hash_genes();
+        on_generation_changed(s);
+      }
+
+      if (rest.valid()) rest.get();
+    }).share();
+}
+
 } // namespace marslander::trainer
@@ -0,0 +1,116 @@
+#include "trainer_app.h"
+#include "trainer_input.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <limits>
+#include <string>
+
+namespace marslander::trainer {
+
+using namespace std;
+
+bool app_args::parse_island_optarg(const string& optarg,
+    const string& delim) {
+  using namespace marslander::input;
+  constexpr unsigned long port_max_ = numeric_limits<in_port_t>::max();
+
+  for (auto& peer : split(string(optarg), delim, true)) {
+    auto port_pos = peer.rfind(':');
+    if (port_pos == string::npos || port_pos == 0
+        || port_pos + 1 == peer.size())
+      return false;
+
+    unsigned long port;
+    if (!cvt_num_ul(peer.substr(port_pos + 1), port, 1, port_max_, 1))
+      return false;
+    island_peers.emplace_back(peer.substr(0, port_pos), in_port_t(port));
+  }
+  return !island_peers.empty();
+}
+
+bool app_args::parse_migration_optarg(const string& optarg) {
+  using namespace marslander::input;
+  constexpr auto ul_max_ = numeric_limits<unsigned long>::max();
+
+  auto tokens = split(optarg, string(";"), true);
+  if (tokens.empty() || tokens.size() > 2) return false;
+
+  unsigned long interval, size = migration_size;
+  if (!cvt_num_ul(tokens[0], interval, 1, ul_max_, 1)) return false;
+  if (tokens.size() > 1 && !cvt_num_ul(tokens[1], size, 1, ul_max_, size))
+    return false;
+
+  migration_interval = interval;
+  migration_size = size;
+  return true;
+}
+
+bool app::is_migration_due(const app_state& s) const {
+  return !_args.island_peers.empty() && _args.migration_interval > 0
+    && s.generation % _args.migration_interval == 0;
+}
+
+void app::emigrate(const app_state& s, app_state::population_t&& migrants) {
+  if (migrants.empty()) return;
+
+  // The looper never waits for peers: a round is skipped while the last
+  // one is still being delivered.
+  if (_emigration.valid()
+      && _emigration.wait_for(chrono::seconds::zero())
+        != future_status::ready) {
+    SPDLOG_LOGGER_WARN(_logger, "Migration of generation #{} is skipped; "
+      "the previous one is still being sent.", s.generation);
+    return;
+  }
+
+  pb::migrants msg;
+  msg.set_island(_args.island_id);
+  msg.set_generation(s.generation);
+  auto msg_data = msg.mutable_data();
+  msg_data->Reserve(migrants.size());
+  move(migrants.begin(), migrants.end(), pb::inserter(msg_data));
+
+  _emigration = island::emigrate(_args.island_peers, move(msg));
+}
+
+// Immigrants take the places of the last children bred; elites stay.
+void app::settle_immigrants(app_state& s) {
+  auto elite_count = min(s.elite_count, s.population.size());
+  auto n = min(s.immigrants.size(), s.population.size() - elite_count);
+
+  for (auto i = s.population.size(); n > 0; --n) {
+    auto& item = s.population[--i];
+    item = move(s.immigrants.front());
+    item.set_id(s.uids.next_uid());
+    s.genes_keys[i] = fitness_cache::hash(item);
+    s.immigrants.pop_front();
+
+    if (i < s.predictions.size())
+      s.predictions[i] = numeric_limits<score_t>::quiet_NaN();
+  }
+}
+
+void app::REQUEST_HANDLER_MEM_DECL_(migrants) {
+  auto& s = state();
+  auto in = request.data();
+
+  size_t genes_count = s.population.empty() ? 0
+    : s.population.front().genes_size();
+
+  size_t accepted = 0;
+  for (auto& item : in->data()) {
+    if (s.immigrants.size() >= s.population_size) break;
+    if (size_t(item.genes_size()) != genes_count) continue;
+
+    s.immigrants.push_back(item);
+    ++accepted;
+  }
+
+  SPDLOG_LOGGER_INFO(_logger, "Island {} > {} of {} migrants accepted "
+      "(generation {}).",
+    in->island(), accepted, in->data_size(), in->generation());
+}
+
+} // namespace marslander::trainer
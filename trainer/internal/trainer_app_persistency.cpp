@@ -1,17 +1,41 @@
 #include "trainer_app.h"
+#include "trainer_input.h"
 
 #include "crc32.h"
+#include "crc32_streambuf.h"
 
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <execution>
 #include <filesystem>
 #include <iostream>
+#include <limits>
+#include <numeric>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
 
 namespace marslander::trainer {
 
 using namespace std;
 
+bool app_args::parse_checkpoint_optarg(const string& optarg) {
+  using namespace marslander::input;
+  constexpr auto ul_max_ = numeric_limits<unsigned long>::max();
+
+  unsigned long saves;
+  if (!cvt_num_ul(optarg, saves, 1, ul_max_, checkpoint_interval))
+    return false;
+
+  checkpoint_interval = saves;
+  return true;
+}
+
 template<class CharT, class Traits, typename T,
   enable_if_t<is_trivial_v<T>, bool> = true>
 basic_istream<CharT, Traits>& binary_read(
@@ -46,9 +70,118 @@ basic_istream<CharT, Traits>& binary_read( basic_istream<CharT, Traits>& is,
   return is;
 }
 
+template<class Container>
+bool coded_read(google::protobuf::io::CodedInputStream& cis,
+    Container& value) {
+  size_t sz;
+  if (!cis.ReadRaw(static_cast<void*>(&sz), sizeof(sz))) return false;
+  value.resize(sz);
+  if (sz <= 0) return true;
+  return cis.ReadRaw(static_cast<void*>(value.data()),
+    int(sizeof(value_type_of(value)) * sz));
+}
+
+namespace {
+
+// The indexed layout puts the marker in front of the header (a check, the
+// first field of the plain one, is a timestamp far below it), and a
+// directory of the records after it. Spans of records are relative to the
+// end of the directory; records go without size prefixes. A footer ends
+// the file: where the records begin and end (past the cases, the genomes
+// come), and checksums of the cases and of the genomes. The checksum in
+// front of the file covers all but the records.
+constexpr uint64_t indexed_layout_marker = 0x32584e49'44534d4cULL;
+
+struct records_footer {
+  uint64_t records_begin, genomes_begin, records_end;
+  checksum::crc32_t cases_checksum, genomes_checksum;
+};
+
+constexpr size_t records_footer_size
+  = 3 * sizeof(uint64_t) + 2 * sizeof(checksum::crc32_t);
+
+bool is_indexed(const mapped_file& file) {
+  uint64_t marker;
+  if (file.size() < sizeof(checksum::crc32_t) + sizeof(marker)) return false;
+  memcpy(&marker, file.data() + sizeof(checksum::crc32_t), sizeof(marker));
+  return marker == indexed_layout_marker;
+}
+
+// False when the footer doesn't fit the file.
+bool read_footer(const mapped_file& file, records_footer& f) {
+  constexpr auto head_size = sizeof(checksum::crc32_t) + sizeof(uint64_t);
+  if (file.size() < head_size + records_footer_size) return false;
+
+  auto p = file.data() + file.size() - records_footer_size;
+  for (auto v : {&f.records_begin, &f.genomes_begin, &f.records_end}) {
+    memcpy(v, p, sizeof(*v));
+    p += sizeof(*v);
+  }
+  for (auto v : {&f.cases_checksum, &f.genomes_checksum}) {
+    memcpy(v, p, sizeof(*v));
+    p += sizeof(*v);
+  }
+  return head_size <= f.records_begin && f.records_begin <= f.genomes_begin
+    && f.genomes_begin <= f.records_end
+    && f.records_end <= file.size() - records_footer_size;
+}
+
+bool verify(const mapped_file& file,
+    const optional<app_state::mapped_body::section>& s) {
+  if (!s) return true;
+
+  checksum::crc32 crc;
+  crc.update(static_cast<const void*>(file.data() + s->from),
+    s->to - s->from);
+  return checksum::crc32_t(crc) == s->checksum;
+}
+
+struct record_directory {
+  std::vector<uid_t> case_ids;
+  mapped_file::spans_t case_spans;
+  std::vector<uid_t> genome_ids;
+  mapped_file::spans_t genome_spans;
+  size_t trailer;
+};
+
+bool read_directory(istream& is, record_directory& d, size_t cases_count,
+    size_t population_size) {
+  binary_read(is, d.case_ids);
+  binary_read(is, d.case_spans);
+  binary_read(is, d.genome_ids);
+  binary_read(is, d.genome_spans);
+  binary_read(is, d.trailer);
+  return is && d.case_ids.size() == cases_count
+    && d.case_spans.size() == cases_count
+    && d.genome_ids.size() == population_size
+    && d.genome_spans.size() == population_size;
+}
+
+// Optional trailer; files written without it are GA sessions.
+void read_trailer(google::protobuf::io::CodedInputStream& cis,
+    app_state& s) {
+  bool has_trailer = coded_read(cis, s.optimizer.name)
+    && coded_read(cis, s.optimizer.values)
+    && coded_read(cis, s.optimizer_state);
+  if (!has_trailer) {
+    s.optimizer = algorithm_args{"ga", {}};
+    s.optimizer_state.clear();
+  }
+
+  bool has_selection = has_trailer
+    && coded_read(cis, s.selection.name)
+    && coded_read(cis, s.selection.values);
+  if (!has_selection)
+    s.selection = algorithm_args{"tournament", {double(s.tournament_size)}};
+}
+
+} // namespace
+
 istream& app_state::read(istream& is, read_mode mode) {
   if (mode & header) {
     binary_read(is, check);
+    indexed_layout = check == indexed_layout_marker;
+    if (indexed_layout) binary_read(is, check);
     binary_read(is, generation);
     binary_read(is, cases_count);
     binary_read(is, population_size);
@@ -63,28 +196,153 @@ istream& app_state::read(istream& is, read_mode mode) {
   }
 
   if (mode & body) {
+    record_directory d;
+    if (indexed_layout
+        && !read_directory(is, d, cases_count, population_size)) {
+      is.setstate(ios_base::failbit);
+      return is;
+    }
+
     size_t sz;
     using namespace google::protobuf::io;
     IstreamInputStream iis(&is);
     CodedInputStream cis(&iis);
     cases.resize(cases_count);
-    for (auto& item : cases) {
-      cis.ReadRaw(static_cast<void*>(&sz), sizeof(sz));
+    for (size_t i = 0; i < cases_count; ++i) {
+      if (indexed_layout) sz = d.case_spans[i].second;
+      else cis.ReadRaw(static_cast<void*>(&sz), sizeof(sz));
       [[maybe_unused]] pb::CodedInputStreamLimitScope sentry_(&cis, sz);
       // TODO: consider making error handling.
-      item.ParseFromCodedStream(&cis);
+      cases[i].ParseFromCodedStream(&cis);
     }
     population.resize(population_size);
-    for (auto& item : population) {
-      cis.ReadRaw(static_cast<void*>(&sz), sizeof(sz));
+    for (size_t i = 0; i < population_size; ++i) {
+      if (indexed_layout) sz = d.genome_spans[i].second;
+      else cis.ReadRaw(static_cast<void*>(&sz), sizeof(sz));
       [[maybe_unused]] pb::CodedInputStreamLimitScope sentry_(&cis, sz);
-      item.ParseFromCodedStream(&cis);
+      population[i].ParseFromCodedStream(&cis);
     }
+
+    read_trailer(cis, *this);
   }
 
   return is;
 }
 
+// Locates the records of the body and reads the trailer; records are
+// left to be parsed on first touch.
+bool app_state::map(shared_ptr<const mapped_file> file, size_t offset) {
+  record_directory d;
+  auto& case_spans = d.case_spans;
+  auto& genome_spans = d.genome_spans;
+  if (indexed_layout) {
+    mapped_buf buf(*file);
+    istream is(&buf);
+    is.seekg(offset);
+    if (!read_directory(is, d, cases_count, population_size)) return false;
+
+    auto base = size_t(is.tellg());
+    offset = base + d.trailer;
+    if (!file->rebase(base, case_spans) || !file->rebase(base, genome_spans)
+        || offset > file->size())
+      return false;
+  }
+  else if (!file->index(offset, cases_count, case_spans)
+      || !file->index(offset, population_size, genome_spans)) {
+    return false;
+  }
+
+  using namespace google::protobuf::io;
+  auto rest = min<size_t>(file->size() - offset, numeric_limits<int>::max());
+  ArrayInputStream ais(file->data() + offset, int(rest));
+  CodedInputStream cis(&ais);
+  read_trailer(cis, *this);
+
+  mapped.cases_section.reset();
+  mapped.genomes_section.reset();
+  if (indexed_layout) {
+    records_footer f;
+    if (!read_footer(*file, f)) return false;
+    mapped.cases_section = {f.records_begin, f.genomes_begin,
+      f.cases_checksum};
+    mapped.genomes_section = {f.genomes_begin, f.records_end,
+      f.genomes_checksum};
+  }
+
+  mapped.cases = {file, move(case_spans)};
+  mapped.population = {file, move(genome_spans)};
+  mapped.file = move(file);
+  mapped.case_ids = move(d.case_ids);
+  mapped.genome_ids = move(d.genome_ids);
+  return true;
+}
+
+// Whether the records still mapped match their checksums; records are
+// parsed on first touch after it, such as by find_case and find_genome.
+bool app_state::mapped_intact() const {
+  return !mapped.file || (verify(*mapped.file, mapped.cases_section)
+    && verify(*mapped.file, mapped.genomes_section));
+}
+
+// Records are parsed across cores once their checksum is verified, if the
+// file has one for them; the mapping is released along with the genomes.
+bool app_state::unmap_cases() {
+  if (mapped.file && !verify(*mapped.file, mapped.cases_section))
+    return false;
+
+  vector<size_t> inds(mapped.cases.size());
+  iota(inds.begin(), inds.end(), 0);
+
+  cases.resize(inds.size());
+  for_each(execution::par, inds.begin(), inds.end(),
+    [this](auto i) { cases[i] = mapped.cases.take(i); });
+
+  mapped.cases = {};
+  mapped.case_ids.clear();
+  return true;
+}
+
+bool app_state::unmap_population() {
+  if (mapped.file && !verify(*mapped.file, mapped.genomes_section))
+    return false;
+
+  vector<size_t> inds(mapped.population.size());
+  iota(inds.begin(), inds.end(), 0);
+
+  population.resize(inds.size());
+  for_each(execution::par, inds.begin(), inds.end(),
+    [this](auto i) { population[i] = mapped.population.take(i); });
+
+  mapped = {};
+  return true;
+}
+
+// Random access to a record that doesn't parse the others; falls back to
+// the indices once unmapped.
+const pb::landing_case* app_state::find_case(uid_t id) const {
+  auto& ids = mapped.case_ids;
+  if (!ids.empty()) {
+    auto it = find(ids.begin(), ids.end(), id);
+    return it != ids.end() ? &mapped.cases[size_t(it - ids.begin())]
+      : nullptr;
+  }
+
+  auto i = cases_index.find(id);
+  return i != id_directory::npos ? &cases[i] : nullptr;
+}
+
+const pb::genome* app_state::find_genome(uid_t id) const {
+  auto& ids = mapped.genome_ids;
+  if (!ids.empty()) {
+    auto it = find(ids.begin(), ids.end(), id);
+    return it != ids.end() ? &mapped.population[size_t(it - ids.begin())]
+      : nullptr;
+  }
+
+  auto i = population_index.find(id);
+  return i != id_directory::npos ? &population[i] : nullptr;
+}
+
 template<class CharT, class Traits, typename T,
   enable_if_t<is_trivial_v<T>, bool> = true>
 basic_ostream<CharT, Traits>& binary_write( basic_ostream<CharT, Traits>& os,
@@ -121,36 +379,218 @@ basic_ostream<CharT, Traits>& binary_write(basic_ostream<CharT, Traits>& os,
   return os;
 }
 
+template<class Container>
+void coded_write(google::protobuf::io::CodedOutputStream& cos,
+    const Container& value) {
+  size_t sz = value.size();
+  cos.WriteRaw(static_cast<const void*>(&sz), sizeof(sz));
+  if (sz <= 0) return;
+  cos.WriteRaw(static_cast<const void*>(value.data()),
+    int(sizeof(value_type_of(value)) * sz));
+}
+
+// Writes a whole training file, the checksums included, which takes a
+// stream that can seek: records go straight to it, everything else
+// through the checksum put in front eventually.
 ostream& app_state::write(ostream& os) const {
-  binary_write(os, check);
-  binary_write(os, generation);
-  binary_write(os, cases_count);
-  binary_write(os, population_size);
-  binary_write(os, elite_count);
-  binary_write(os, tournament_size);
-  binary_write(os, crossover);
-  binary_write(os, mutation);
-  binary_write(os, uids.value());
+  using namespace checksum;
 
+  auto front = os.tellp();
+  binary_write(os, crc32_t{});
+  crc32_streambuf meta_sb(os.rdbuf());
+  ostream meta(&meta_sb);
+  auto position = [&os, front]() { return uint64_t(os.tellp() - front); };
+
+  binary_write(meta, indexed_layout_marker);
+  binary_write(meta, check);
+  binary_write(meta, generation);
+  binary_write(meta, cases_count);
+  binary_write(meta, population_size);
+  binary_write(meta, elite_count);
+  binary_write(meta, tournament_size);
+  binary_write(meta, crossover);
+  binary_write(meta, mutation);
+  binary_write(meta, uids.value());
+
+  // Offspring under evaluation in steady-state mode are not persisted.
+  record_directory d;
+  size_t offset = 0;
+  for (auto& item : cases) {
+    auto sz = item.ByteSizeLong();
+    d.case_ids.push_back(item.id());
+    d.case_spans.emplace_back(offset, sz);
+    offset += sz;
+  }
+  for (size_t i = 0; i < population_size; ++i) {
+    auto sz = population[i].ByteSizeLong();
+    d.genome_ids.push_back(population[i].id());
+    d.genome_spans.emplace_back(offset, sz);
+    offset += sz;
+  }
+  binary_write(meta, d.case_ids);
+  binary_write(meta, d.case_spans);
+  binary_write(meta, d.genome_ids);
+  binary_write(meta, d.genome_spans);
+  binary_write(meta, offset);
+
+  using namespace google::protobuf::io;
+  records_footer f;
+  crc32_streambuf records_sb(os.rdbuf());
+  ostream records(&records_sb);
+  f.records_begin = position();
   {
-    size_t sz;
-    using namespace google::protobuf::io;
-    OstreamOutputStream oos(&os);
+    OstreamOutputStream oos(&records);
     CodedOutputStream cos(&oos);
-    for (auto& item : cases) {
-      sz = item.ByteSizeLong();
-      cos.WriteRaw(static_cast<void*>(&sz), sizeof(sz));
-      // TODO: consider making error handling.
-      item.SerializeToCodedStream(&cos);
-    }
-    for (auto& item : population) {
-      sz = item.ByteSizeLong();
-      cos.WriteRaw(static_cast<void*>(&sz), sizeof(sz));
-      item.SerializeToCodedStream(&cos);
+    // TODO: consider making error handling.
+    for (auto& item : cases) item.SerializeWithCachedSizes(&cos);
+  }
+  f.cases_checksum = records_sb.checksum();
+  f.genomes_begin = position();
+  records_sb.reset();
+  {
+    OstreamOutputStream oos(&records);
+    CodedOutputStream cos(&oos);
+    for (size_t i = 0; i < population_size; ++i)
+      population[i].SerializeWithCachedSizes(&cos);
+  }
+  f.genomes_checksum = records_sb.checksum();
+  f.records_end = position();
+
+  {
+    OstreamOutputStream oos(&meta);
+    CodedOutputStream cos(&oos);
+    coded_write(cos, optimizer.name);
+    coded_write(cos, optimizer.values);
+    coded_write(cos, popt ? popt->save() : optimizer_state);
+    coded_write(cos, selection.name);
+    coded_write(cos, selection.values);
+  }
+
+  binary_write(meta, f.records_begin);
+  binary_write(meta, f.genomes_begin);
+  binary_write(meta, f.records_end);
+  binary_write(meta, f.cases_checksum);
+  binary_write(meta, f.genomes_checksum);
+  if (!meta || !records) os.setstate(ios_base::failbit);
+
+  auto end = os.tellp();
+  os.seekp(front);
+  binary_write(os, meta_sb.checksum());
+  return os.seekp(end);
+}
+
+namespace {
+
+// Records of the logs: payload size, payload CRC, then the payload.
+ostream& write_record(ostream& os, const string& data) {
+  checksum::crc32 crc;
+  crc.update(static_cast<const void*>(data.data()), data.size());
+  binary_write(os, data.size());
+  binary_write(os, checksum::crc32_t(crc));
+  return os.write(data.data(), data.size());
+}
+
+// False at the end of the log, or on a torn or corrupted record.
+bool read_record(istream& is, string& data) {
+  constexpr size_t max_record_size = size_t(1) << 32;
+
+  size_t sz;
+  checksum::crc32_t cs;
+  if (!binary_read(is, sz) || sz > max_record_size || !binary_read(is, cs))
+    return false;
+  data.resize(sz);
+  if (!is.read(data.data(), sz)) return false;
+
+  checksum::crc32 crc;
+  crc.update(static_cast<const void*>(data.data()), data.size());
+  return checksum::crc32_t(crc) == cs;
+}
+
+} // namespace
+
+// Checkpoint payload: check, generation, uids value, population ids, new
+// genomes and the optimizer state.
+ostream& app_state::write_checkpoint(ostream& os) const {
+  ostringstream payload(ios_base::binary);
+  binary_write(payload, check);
+  binary_write(payload, generation);
+  binary_write(payload, uids.value());
+
+  vector<uid_t> ids(population_size);
+  vector<const pb::genome*> issued;
+  for (size_t i = 0; i < population_size; ++i) {
+    auto& item = population[i];
+    ids[i] = item.id();
+    if (item.id() > journal.uid) issued.push_back(&item);
+  }
+  binary_write(payload, ids);
+
+  binary_write(payload, issued.size());
+  for (auto p : issued) binary_write(payload, p->SerializeAsString());
+  binary_write(payload, popt ? popt->save() : optimizer_state);
+
+  return write_record(os, payload.str());
+}
+
+// Applies the records past the state read so far; stops at the first torn
+// or corrupted one. Records of the other base (a compaction interrupted
+// before the log got truncated) are skipped.
+size_t app_state::replay_checkpoints(istream& is) {
+  vector<uid_t> base_ids;
+  unordered_map<uid_t, pb::genome> known;
+  for (auto& item : population) {
+    base_ids.push_back(item.id());
+    known.emplace(item.id(), move(item));
+  }
+
+  size_t applied = 0;
+  string data;
+  while (read_record(is, data)) {
+    istringstream rec(move(data), ios_base::binary);
+    decltype(check) rec_check;
+    size_t rec_generation, issued_count;
+    uid_t rec_uid;
+    vector<uid_t> ids;
+    binary_read(rec, rec_check);
+    binary_read(rec, rec_generation);
+    binary_read(rec, rec_uid);
+    binary_read(rec, ids);
+    binary_read(rec, issued_count);
+    if (!rec || rec_check != check) break;
+
+    for (size_t k = 0; rec && k < issued_count; ++k) {
+      string bytes;
+      pb::genome item;
+      if (binary_read(rec, bytes) && item.ParseFromString(bytes))
+        known.insert_or_assign(item.id(), move(item));
+      else
+        rec.setstate(ios_base::failbit);
     }
+    optimizer_algo::state_t rec_state;
+    if (!binary_read(rec, rec_state)) break;
+
+    if (make_pair(rec_uid, rec_generation)
+        <= make_pair(uids.value(), generation))
+      continue;
+    if (ids.size() != population_size || any_of(ids.begin(), ids.end(),
+        [&known](auto id) { return known.find(id) == known.end(); }))
+      break;
+
+    generation = rec_generation;
+    uids = uid_source(rec_uid);
+    optimizer_state = move(rec_state);
+    population.resize(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) population[i] = known[ids[i]];
+    ++applied;
   }
 
-  return os;
+  if (applied <= 0) {
+    for (size_t i = 0; i < base_ids.size(); ++i)
+      population[i] = move(known[base_ids[i]]);
+  }
+  journal.records = applied;
+  journal.uid = uids.value();
+  return applied;
 }
 
 namespace {
@@ -185,60 +625,242 @@ void back_up_existing(const string_view& filename, const app_state& state) {
 
 using namespace marslander::checksum;
 
-template<class CharT, class Traits>
-crc32_t find_checksum(basic_istream<CharT, Traits>& is) {
-  if (!is) return crc32_t{};
-  constexpr size_t buf_sz = 1024 * 1024;
-  auto buf_ptr = make_unique<char[]>(buf_sz);
-  crc32 crc;
-  while (is) {
-    is.read(buf_ptr.get(), buf_sz);
-    crc.update(static_cast<void*>(buf_ptr.get()), is.gcount());
+// Files of sweep sessions are named after the session.
+filesystem::path session_path(const filesystem::path& directory,
+    const app_state& state, string_view filename, string_view ext) {
+  return directory / (state.session != 0
+    ? fmt::format("training.sweep{}.{}", state.session, ext)
+    : string(filename));
+}
+
+// Ratings of each generation are logged into a file of their own.
+filesystem::path ratings_path(const filesystem::path& directory,
+    string_view filename, size_t generation) {
+  return directory / fmt::format("{}.{}", filename, generation);
+}
+
+// Removes the ratings logs of the generations before the given one, which
+// a saved checkpoint has moved past.
+void drop_ratings(const filesystem::path& directory, string_view filename,
+    size_t generation) {
+  error_code ec;
+  for (filesystem::directory_iterator it(directory, ec), end;
+      !ec && it != end; it.increment(ec)) {
+    auto name = it->path().filename().string();
+    if (name.size() <= filename.size() + 1
+        || name.compare(0, filename.size(), filename) != 0
+        || name[filename.size()] != '.')
+      continue;
+
+    size_t log_generation;
+    auto first = name.data() + filename.size() + 1,
+      last = name.data() + name.size();
+    auto [ptr, err] = from_chars(first, last, log_generation);
+    if (err == errc{} && ptr == last && log_generation < generation) {
+      error_code remove_ec;
+      filesystem::remove(it->path(), remove_ec);
+    }
   }
-  return crc;
 }
 
 } // namespace
 
-std::ifstream& app::check_integrity(std::ifstream& is) {
-  if (is) {
-    crc32_t cs_actual;
-    binary_read(is, cs_actual);
-
-    auto ofs_beg = is.tellg();
-    auto cs_expected = find_checksum(is);
+// Files of the indexed layout are checked but for their records, which
+// are verified as they're unmapped; the others are checked whole.
+bool app::check_integrity(const mapped_file& file) {
+  crc32_t cs_actual;
+  if (file.size() < sizeof(cs_actual)) return false;
+  memcpy(&cs_actual, file.data(), sizeof(cs_actual));
 
-    is.clear();
-    is.seekg(ofs_beg, ios_base::beg);
+  crc32 crc;
+  auto data = file.data();
+  if (is_indexed(file)) {
+    records_footer f;
+    if (!read_footer(file, f)) return false;
+    crc.update(static_cast<const void*>(data + sizeof(cs_actual)),
+      f.records_begin - sizeof(cs_actual));
+    crc.update(static_cast<const void*>(data + f.records_end),
+      file.size() - f.records_end);
+  }
+  else {
+    crc.update(static_cast<const void*>(data + sizeof(cs_actual)),
+      file.size() - sizeof(cs_actual));
+  }
+  crc32_t cs_expected = crc;
 
-    if (cs_expected != cs_actual) {
-      is.setstate(ios_base::badbit);
-      SPDLOG_LOGGER_DEBUG(_logger, "Checksum mismatch! Found {}, "
-        "but {} was expected.", cs_actual, cs_expected);
-    }
-    else {
-      SPDLOG_LOGGER_TRACE(_logger, "Checksum is OK ({}).", cs_actual);
-    }
+  if (cs_expected != cs_actual) {
+    SPDLOG_LOGGER_DEBUG(_logger, "Checksum mismatch! Found {}, "
+      "but {} was expected.", cs_actual, cs_expected);
+    return false;
   }
 
-  return is;
+  SPDLOG_LOGGER_TRACE(_logger, "Checksum is OK ({}).", cs_actual);
+  return true;
 }
 
-void app::persist_state(const app_state& state) {
+void app::persist_state(app_state& state,
+    const filesystem::path& directory) {
   // back_up_existing(training_filename, state);
 
-  constexpr auto file_mode = ios_base::in | ios_base::out
-    | ios_base::binary | ios_base::trunc;
-  fstream f(training_filename, file_mode);
+  auto journal_path = session_path(directory, state, journal_filename, "log");
+
+  // A zero watermark means there's no base to append to yet.
+  if (state.journal.uid > 0
+      && state.journal.records + 1 < state.journal.interval) {
+    ofstream f(journal_path, ios_base::binary | ios_base::app);
+    if (state.write_checkpoint(f).flush()) {
+      ++state.journal.records;
+      state.journal.uid = state.uids.value();
+      if (state.session == 0)
+        drop_ratings(directory, ratings_filename, state.generation);
+      return;
+    }
+  }
 
-  using namespace checksum;
-  crc32_t cs{};
-  auto cs_ofs_beg = f.tellp();
-  binary_write(f, cs);
-  auto data_ofs_beg = f.tellp();
+  // The new base is written aside and renamed over the old one, so that
+  // the base and its log survive a crash halfway through.
+  auto path = session_path(directory, state, training_filename, "dat");
+  auto tmp_path = path;
+  tmp_path += ".tmp";
+  ofstream f(tmp_path, ios_base::binary | ios_base::trunc);
   state.write(f);
-  cs = find_checksum(f.seekg(data_ofs_beg, ios_base::beg));
-  binary_write((f.clear(), f.seekp(cs_ofs_beg, ios_base::beg)), cs);
+  f.close();
+
+  error_code ec;
+  if (f) filesystem::rename(tmp_path, path, ec);
+  if (!f || ec) {
+    SPDLOG_LOGGER_WARN(_logger, "Failed to write {}; the previous one and "
+      "its log are kept.", path);
+    filesystem::remove(tmp_path, ec);
+    return;
+  }
+
+  // The new base supersedes the log; records left over should the
+  // truncation not happen are skipped on replay as being older.
+  ofstream(journal_path, ios_base::binary | ios_base::trunc);
+  state.journal.records = 0;
+  state.journal.uid = state.uids.value();
+  if (state.session == 0)
+    drop_ratings(directory, ratings_filename, state.generation);
+}
+
+// Resumes a sweep session from its own training file and log, unless they
+// are missing or were saved with other cases or another population size;
+// the configuration stays the one given by the sweep file.
+bool app::restore_session(app_state& state,
+    const filesystem::path& directory) {
+  auto file = make_shared<const mapped_file>(
+    session_path(directory, state, training_filename, "dat"));
+  if (!*file || !check_integrity(*file)) return false;
+
+  // Read the way the main training file is, since the body may run up to
+  // the end of the file.
+  app_state saved;
+  size_t offset;
+  {
+    mapped_buf buf(*file);
+    istream is(&buf);
+    is.seekg(sizeof(crc32_t));
+    if (!saved.read(is, app_state::header) || saved.check != state.check
+        || saved.population_size != state.population_size)
+      return false;
+
+    offset = size_t(is.tellg());
+  }
+  if (!saved.map(move(file), offset) || !saved.unmap_cases()
+      || !saved.unmap_population())
+    return false;
+
+  if (ifstream journal{session_path(directory, state, journal_filename, "log"),
+      ios::binary})
+    saved.replay_checkpoints(journal);
+  else
+    saved.journal.uid = saved.uids.value();
+
+  state.generation = saved.generation;
+  state.uids = uid_source(saved.uids.value());
+  state.population = move(saved.population);
+  state.journal.records = saved.journal.records;
+  state.journal.uid = saved.journal.uid;
+  return true;
+}
+
+// Ratings payload: check, generation and the ratings. Each generation
+// starts a log of its own, so the log of the last one stays until
+// persist_state saves the checkpoint that moves past it. Sweep sessions
+// resume from the start of their generation, so there's nothing to log
+// for them.
+void app::log_ratings(app_state& state, const filesystem::path& directory,
+    const vector<app_state::rating_record>& ratings) {
+  if (ratings.empty() || state.session != 0 || state.steady_state()) return;
+
+  auto& log = state.ratings_log;
+  if (!log.file.is_open() || log.generation != state.generation) {
+    log.file.close();
+    log.file.clear();
+    log.file.open(ratings_path(directory, ratings_filename, state.generation),
+      ios_base::binary | ios_base::trunc);
+    log.generation = state.generation;
+  }
+
+  ostringstream payload(ios_base::binary);
+  binary_write(payload, state.check);
+  binary_write(payload, state.generation);
+  binary_write(payload, ratings);
+  write_record(log.file, payload.str()).flush();
+}
+
+// Puts the ratings of the current generation back into the results table
+// and rewrites its log with them only, past any torn record. Logs of the
+// generations before are left over from a save that completed right
+// before a restart, and are dropped.
+size_t app::restore_ratings(app_state& state,
+    const filesystem::path& directory) {
+  drop_ratings(directory, ratings_filename, state.generation);
+  ifstream is(ratings_path(directory, ratings_filename, state.generation),
+    ios_base::binary);
+  if (!is) return 0;
+
+  vector<app_state::rating_record> restored;
+  string data;
+  while (read_record(is, data)) {
+    istringstream rec(move(data), ios_base::binary);
+    decltype(state.check) rec_check;
+    size_t rec_generation;
+    vector<app_state::rating_record> ratings;
+    binary_read(rec, rec_check);
+    binary_read(rec, rec_generation);
+    binary_read(rec, ratings);
+    if (!rec) break;
+    if (rec_check != state.check || rec_generation != state.generation)
+      continue;
+
+    for (auto& r : ratings) {
+      auto case_ind = state.cases_index.find(r.case_id);
+      auto population_ind = state.population_index.find(r.genome_id);
+      if (case_ind == id_directory::npos
+          || population_ind == id_directory::npos
+          || population_ind >= state.results.rows()
+          || case_ind >= state.results.cols())
+        continue;
+
+      auto& cell = state.results[population_ind][case_ind];
+      if (!std::isnan(cell)) continue;
+      cell = r.rating;
+      restored.push_back(r);
+    }
+  }
+
+  if (!restored.empty()) {
+    state.begin_race();
+    state.begin_fidelity();
+    state.reset_units();
+  }
+
+  is.close();
+  state.ratings_log.file.close();
+  log_ratings(state, directory, restored);
+  return restored.size();
 }
 
 } // namespace marslander::trainer
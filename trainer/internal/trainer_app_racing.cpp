@@ -0,0 +1,115 @@
+#include "trainer_app.h"
+#include "trainer_input.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+
+namespace marslander::trainer {
+
+using namespace std;
+
+bool app_args::parse_racing_optarg(const string& optarg) {
+  using namespace marslander::input;
+  constexpr auto ul_max_ = numeric_limits<unsigned long>::max();
+
+  auto tokens = split(optarg, string(";"), true);
+  if (tokens.empty() || tokens.size() > 2) return false;
+
+  unsigned long min_cases;
+  double keep = racing_keep;
+  if (!cvt_num_ul(tokens[0], min_cases, 0, ul_max_, 0)) return false;
+  if (tokens.size() > 1 && !cvt_num_dbl(tokens[1], keep, 0, 1, keep))
+    return false;
+  if (keep <= 0 || keep >= 1) return false;
+
+  racing_min_cases = min_cases;
+  racing_keep = keep;
+  return true;
+}
+
+void app_state::begin_race() {
+  race.culled.assign(population.size(), false);
+  race.culled_count = 0;
+  race.simulations_saved = 0;
+  race.offset = 0;
+  race.stage_begin = 0;
+  race.stage_end = cases.size();
+  if (!racing()) return;
+
+  uniform_int_distribution<size_t> d{0, cases.size() - 1};
+  race.offset = d(*prng);
+  race.stage_end = race.min_cases;
+}
+
+// Returns true when the current stage is complete and the next one has
+// begun; the last stage completes along with the generation itself.
+bool app_state::advance_race() {
+  if (!racing()) return false;
+
+  auto n = cases.size();
+  auto cell = [this, n](size_t i, size_t k) -> results_table::value_type& {
+    return results[i][(race.offset + k) % n];
+  };
+
+  bool stage_done = true;
+  for (size_t i = 0, imax = population.size(); i < imax; ++i) {
+    if (race.culled[i]) continue;
+
+    bool done = true;
+    for (auto k = race.stage_begin; done && k < race.stage_end; ++k)
+      done = !std::isnan(cell(i, k));
+
+    if (!done) stage_done = false;
+  }
+  if (!stage_done || race.stage_end >= n) return false;
+
+  vector<size_t> alive;
+  vector<score_t> score(population.size());
+  for (size_t i = 0, imax = population.size(); i < imax; ++i) {
+    if (race.culled[i]) continue;
+
+    alive.push_back(i);
+    score_t sum{};
+    for (size_t k = 0; k < race.stage_end; ++k) sum += cell(i, k);
+    score[i] = sum / race.stage_end;
+  }
+
+  auto keep_count = max<size_t>({
+    size_t(ceil(alive.size() * race.keep)),
+    min(elite_count, alive.size()),
+    1});
+
+  if (keep_count < alive.size()) {
+    nth_element(alive.begin(), next(alive.begin(), keep_count), alive.end(),
+      [&score](auto u, auto v) { return score[u] < score[v]; });
+
+    auto worst = numeric_limits<results_table::value_type>::lowest();
+    for (auto&& [i, row_from, row_to] : results)
+    for (auto it = row_from; it != row_to; ++it)
+      if (!std::isnan(*it)) worst = max(worst, *it);
+
+    for (auto it = next(alive.begin(), keep_count); it != alive.end(); ++it) {
+      auto i = *it;
+      race.culled[i] = true;
+      ++race.culled_count;
+      for (auto row = results[i], row_end = row + n; row != row_end; ++row) {
+        if (!std::isnan(*row)) continue;
+        *row = worst;
+        ++race.simulations_saved;
+      }
+      complete_units(i);
+    }
+    alive.resize(keep_count);
+  }
+
+  race.stage_begin = race.stage_end;
+  race.stage_end = min(n, size_t(ceil(race.stage_end / race.keep)));
+  reset_units();
+
+  return true;
+}
+
+} // namespace marslander::trainer
@@ -1,26 +1,48 @@
 #include "trainer_app.h"
+#include "trainer_input.h"
 
 #include <algorithm>
+#include <limits>
+#include <string>
 
 namespace marslander::trainer {
 
 using namespace std;
 
+bool app_args::parse_speculation_optarg(const string& optarg) {
+  using namespace marslander::input;
+  constexpr auto ul_max_ = numeric_limits<unsigned long>::max();
+
+  auto tokens = split(optarg, string(";"), true);
+  if (tokens.empty() || tokens.size() > 2) return false;
+
+  unsigned long threshold, copies = speculation_copies;
+  if (!cvt_num_ul(tokens[0], threshold, 0, ul_max_, 0)) return false;
+  if (tokens.size() > 1 && !cvt_num_ul(tokens[1], copies, 0, 255, copies))
+    return false;
+
+  speculation_threshold = threshold;
+  speculation_copies = copies;
+  return true;
+}
+
 void app::on_server_initialized() {
   using namespace std::placeholders;
-#define MEM_FUN_HANDLER_(msg) server::handler<pb::msg>(\
-    bind(&app::on_ ## msg ## _request, this, _1, _2))
+#define MEM_FUN_HANDLER_(msg, st) server::handler<pb::msg>(\
+    bind(&app::on_ ## msg ## _request, this, _1, _2), ready(stage::st))
   server::start(_args.port,
   {
-    MEM_FUN_HANDLER_(cases),
-    MEM_FUN_HANDLER_(outcomes),
+    MEM_FUN_HANDLER_(cases, cases),
+    MEM_FUN_HANDLER_(outcomes, population),
+    MEM_FUN_HANDLER_(migrants, results),
+    MEM_FUN_HANDLER_(heartbeat, results),
   });
 
   cout << "Listening on port " << _args.port << endl;
 }
 
 void app::REQUEST_HANDLER_MEM_DECL_(cases) {
-  auto& s = state();
+  auto& s = state(stage::cases);
   auto in = request.data();
   auto out = in->New(in->GetArena());
   auto out_data = out->mutable_data();
@@ -29,4 +51,17 @@ void app::REQUEST_HANDLER_MEM_DECL_(cases) {
   response.append(out);
 }
 
+void app::REQUEST_HANDLER_MEM_DECL_(heartbeat) {
+  auto& s = state();
+  auto in = request.data();
+  auto now = lease_dispatcher::clock_t::now();
+  for (auto ps : sessions_by_share())
+    ps->dispatcher.heartbeat(in->client_name(), now);
+
+  auto out = in->New(in->GetArena());
+  out->set_client_name(in->client_name());
+  out->set_generation(s.generation);
+  response.append(out);
+}
+
 } // namespace marslander::trainer
@@ -6,25 +6,15 @@
 #include <cmath>
 #include <execution>
 #include <iterator>
+#include <future>
 #include <limits>
+#include <optional>
 #include <random>
 
 namespace marslander::trainer {
 
 using namespace std;
 
-constexpr inline auto results_timeout = 30s;
-
-void app_state::reset_results() {
-  index = 0;
-  timeouts.clear();
-  constexpr auto default_timeout = timeout_clock_t::time_point() - results_timeout;
-  timeouts.resize(population.size(), default_timeout);
-  timeouts.shrink_to_fit();
-  results.resize(cases.size(), population.size(),
-      std::numeric_limits<decltype(results)::value_type>::quiet_NaN());
-}
-
 void app::on_generation_changed(app_state& s) {
   s.rebuild_indices();
   s.reset_results();
@@ -37,21 +27,15 @@ namespace {
 struct generation_stats {
   size_t generation;
   score_t score_best, score_worst;
-};
-
-class xvr_tournament final {
-  uniform_int_distribution<size_t> _d;
-public:
-  xvr_tournament(size_t ofs, size_t total) : _d{ofs, total - 1} {}
-  template<class Rng>
-  size_t operator()(Rng&& rng, size_t size) {
-    auto result = ~size_t{};
-    while (size--) {
-      auto v = _d(rng);
-      if (v < result) result = v;
-    }
-    return result;
-  }
+  size_t cache_hits, cache_lookups, simulations_saved;
+  size_t ratings_discarded;
+  size_t racing_culled, racing_simulations_saved;
+  size_t coarse_promoted;
+  double coarse_rank_corr;
+  double surrogate_rank_corr;
+  app_state::population_t top;
+  // Engaged when the history archive is kept.
+  optional<generation_history> history;
 };
 
 class xvr_iterator final : public child_output_query<pb::genome> {
@@ -94,167 +78,399 @@ public:
 
 #define ALIGN_(v, n) ((((v) + (n - 1)) / (n)) * (n))
 
-void next_generation(app_state& state, generation_stats& out_stats) {
+void collect_stats(const app_state& state, generation_stats& out_stats) {
+  out_stats.generation = state.generation;
+  out_stats.cache_hits = state.cache_hits;
+  out_stats.cache_lookups = state.population.size();
+  out_stats.simulations_saved = state.cache_hits * state.cases.size();
+  out_stats.ratings_discarded = state.ratings_discarded;
+  out_stats.racing_culled = state.race.culled_count;
+  out_stats.racing_simulations_saved = state.race.simulations_saved;
+  out_stats.coarse_promoted = state.fidelity.promoted;
+  out_stats.coarse_rank_corr = state.fidelity.rank_corr;
+  out_stats.surrogate_rank_corr = numeric_limits<double>::quiet_NaN();
+}
+
+// Breeds the next generation into state.rollover; the current population
+// and its results are only read, as they're still being served meanwhile.
+void next_generation(app_state& state, generation_stats& out_stats,
+    size_t top_count = 0) {
   vector<size_t> inds(state.population.size());
+  vector<score_t> score(state.population.size());
   {
-    vector<score_t> score(state.population.size());
+    // fast_sum works in place, so it's given a copy of each row.
     transform(execution::par_unseq,
       state.results.begin(), state.results.end(), score.begin(),
       [d = state.results.cols()](auto&& row_p) {
+        vector<results_table::value_type> row(get<1>(row_p), get<2>(row_p));
         // TODO: score calculation may be a subject for change.
-        return fp::fast_sum(get<1>(row_p), get<2>(row_p)) / d;
+        return fp::fast_sum(row.begin(), row.end()) / d;
       });
 
+    // Only elites and emigrants need an exact order, unless selection
+    // works on ranks.
+    auto ranked = !state.popt && state.psel->meta().ranked;
+    auto sorted_count = ranked ? inds.size()
+      : min(max(state.elite_count, top_count), inds.size());
+
     iota(inds.begin(), inds.end(), 0);
-    sort(inds.begin(), inds.end(), [&score](auto u, auto v) {
-      return score[u] < score[v];
-    });
+    partial_sort(inds.begin(), next(inds.begin(), sorted_count), inds.end(),
+      [&score](auto u, auto v) { return score[u] < score[v]; });
+
+    auto [best, worst] = minmax_element(score.begin(), score.end());
+    out_stats.score_best = *best;
+    out_stats.score_worst = *worst;
+
+    out_stats.top.clear();
+    for (size_t i = 0, imax = min(top_count, inds.size()); i < imax; ++i)
+      out_stats.top.push_back(state.population[inds[i]]);
+
+    if (auto& h = out_stats.history) {
+      h->generation = state.generation;
+      h->scores = score;
+      h->ids.clear();
+      for (auto& g : state.population) h->ids.push_back(g.id());
+      h->elite_ids.clear();
+      if (!state.popt) {
+        for (size_t i = 0, imax = min(state.elite_count, inds.size());
+            i < imax; ++i)
+          h->elite_ids.push_back(state.population[inds[i]].id());
+      }
+      // Ratings below that of the best crash are landings; rows of culled
+      // genomes are partly made up.
+      constexpr results_table::value_type landed_below = 100;
+      h->landing_rates.assign(state.results.cols(), 0);
+      size_t rows = 0;
+      for (auto&& [i, row_from, row_to] : state.results) {
+        if (i < state.race.culled.size() && state.race.culled[i]) continue;
+        ++rows;
+        for (auto it = row_from; it != row_to; ++it)
+          if (*it < landed_below) ++h->landing_rates[it - row_from];
+      }
+      for (auto& v : h->landing_rates) v /= max<size_t>(rows, 1);
+    }
+  }
 
-    out_stats.generation = state.generation;
-    out_stats.score_best = score[inds.front()];
-    out_stats.score_worst = score[inds.back()];
+  auto& new_pop = state.rollover.population;
+  auto& new_keys = state.rollover.genes_keys;
+  state.rollover.generation = state.generation + 1;
+
+  if (state.popt) {
+    new_pop = state.population;
+    state.popt->exec(score, new_pop);
+    for (auto& g : new_pop) g.set_id(state.uids.next_uid());
+    new_keys.resize(new_pop.size());
+    transform(execution::par_unseq, new_pop.begin(), new_pop.end(),
+      new_keys.begin(), &fitness_cache::hash);
+    return;
   }
 
-  app_state::population_t new_pop;
+  out_stats.surrogate_rank_corr = state.observe_scores(score);
 
+  new_pop.clear();
+  new_keys.clear();
+
+  bool screening = state.screening();
   auto xvr_growth = state.pxvr->meta().growth;
   auto pop_elite_count = min(state.elite_count, state.population_size);
-  auto pop_crossover_count = ALIGN_(
-    state.population_size - pop_elite_count, xvr_growth);
+  auto pop_offspring_count = state.population_size - pop_elite_count;
+  auto pop_crossover_count = ALIGN_(size_t(ceil(pop_offspring_count
+    * (screening ? state.surrogate_factor : 1.))), xvr_growth);
 
   auto new_pop_capacity = pop_elite_count + pop_crossover_count;
   new_pop.reserve(new_pop_capacity);
 
   // pick elite
-  for (size_t i = 0; i < pop_elite_count; ++i)
-    new_pop.push_back(move(state.population[inds[i]]));
+  for (size_t i = 0; i < pop_elite_count; ++i) {
+    new_pop.push_back(state.population[inds[i]]);
+    new_keys.push_back(state.genes_keys[inds[i]]);
+  }
 
   // crossover, mutate the rest
   if (pop_crossover_count) {
     auto xvr_ofs = new_pop.size();
     new_pop.resize(new_pop_capacity);
 
+    // Parents are picked among the non-elite individuals.
+    auto candidates = next(inds.begin(), pop_elite_count);
+    vector<score_t> candidates_score(distance(candidates, inds.end()));
+    transform(candidates, inds.end(), candidates_score.begin(),
+      [&score](auto i) { return score[i]; });
+    state.psel->prepare(candidates_score);
+
     for_each(execution::par_unseq,
       xvr_iterator(new_pop, xvr_growth, xvr_ofs), xvr_iterator(new_pop),
-      [
-        &state,
-        &inds,
-        t = xvr_tournament(pop_elite_count, state.population_size)
-      ]
-      (auto& q) mutable {
-        auto x1 = t(*state.prng, state.tournament_size);
-        auto x2 = t(*state.prng, state.tournament_size);
-        state.pxvr->exec(state.population[inds[x1]],
-          state.population[inds[x2]], q, int(x1 - x2));
+      [&state, &score, candidates] (auto& q) {
+        auto x1 = candidates[state.psel->exec()];
+        auto x2 = candidates[state.psel->exec()];
+        state.pxvr->exec(state.population[x1], state.population[x2], q,
+          int(score[x1] > score[x2]) - int(score[x1] < score[x2]));
       });
 
+    // Children are to be mutated before the surrogate may judge them.
+    if (screening) {
+      for_each(execution::par_unseq,
+        next(new_pop.begin(), xvr_ofs), new_pop.end(),
+        [&state](auto& g) mutable { state.pmtn->exec(g); });
+      state.screen_offspring(new_pop, xvr_ofs, pop_offspring_count);
+    }
+
     new_pop.resize(state.population_size);
     new_pop.shrink_to_fit();
+    new_keys.resize(new_pop.size());
 
+    // Children are keyed for the fitness cache as they're done.
     for_each(execution::par_unseq,
       next(new_pop.begin(), xvr_ofs), new_pop.end(),
-      [&state](auto& g) mutable {
-        state.pmtn->exec(g);
+      [&state, &new_pop, &new_keys, screening](auto& g) mutable {
+        if (!screening) state.pmtn->exec(g);
         g.set_id(state.uids.next_uid());
+        new_keys[size_t(&g - new_pop.data())] = fitness_cache::hash(g);
       });
   }
-
-  state.population = move(new_pop);
-  state.generation += 1;
 }
 
-template<typename T>
-using unary_pred_fptr = bool (*)(T);
-constexpr inline unary_pred_fptr<results_table::value_type> pred_std_isnan
-  = std::isnan;
-
 } // namespace
 
-void app::REQUEST_HANDLER_MEM_DECL_(outcomes) {
-  auto& s = state();
-  auto in = request.data();
+// Rates the outcomes into their session; the returned future is a state
+// write that's to be joined before the population changes again.
+future<void> app::take_outcomes(const pb::outcomes* in) {
+  // A runner's outcomes all come from one population it's been given.
+  auto& s = in->data_size() ? session_of(in->data(0).genome_id()) : state();
 
-  if (in->data_size() && in->generation() != s.generation) {
+  if (in->data_size() && in->generation() != s.generation
+      && !s.steady_state()) {
     SPDLOG_LOGGER_WARN(_logger, "{} > unexpected generation {}!",
       in->client_name(), in->generation());
   }
 
-  using clk_t = app_state::timeout_clock_t;
-  auto now = clk_t::now();
+  auto now = lease_dispatcher::clock_t::now();
+  for (auto ps : sessions_by_share())
+    ps->dispatcher.report(in->client_name(), now, in->data_size());
+
+  vector<size_t> units;
+  vector<app_state::rating_record> ratings;
   for (int i = 0, imax = in->data_size(); i < imax; ++i){
     auto& src = in->data(i);
     auto case_ind = s.cases_index.find(src.case_id());
-    if (case_ind == s.cases_index.end()) {
+    if (case_ind == id_directory::npos) {
       SPDLOG_LOGGER_WARN(_logger, "{} > unknown case id: {}, skipping.",
         in->client_name(), src.case_id());
       continue;
     }
 
     auto population_ind = s.population_index.find(src.genome_id());
-    if (population_ind == s.population_index.end()) {
+    if (population_ind == id_directory::npos) {
       SPDLOG_LOGGER_WARN(_logger, "{} > unknown genome id: {}, skipping.",
         in->client_name(), src.genome_id());
       continue;
     }
 
-    s.timeouts[population_ind->second] = now;
-    s.results[population_ind->second][case_ind->second] = src.rating();
+    auto& table = in->fidelity() == pb::FIDELITY_COARSE
+      ? s.fidelity.results : s.results;
+    if (population_ind >= table.rows() || case_ind >= table.cols()) continue;
+
+    auto& cell = table[population_ind][case_ind];
+    if (!std::isnan(cell)) ++s.ratings_discarded;
+    else {
+      cell = src.rating();
+      if (&table == &s.results)
+        ratings.push_back({src.genome_id(), src.case_id(), cell});
+    }
+
+    auto u = s.unit_of(population_ind, case_ind);
+    if (u < s.dispatcher.size()) units.push_back(u);
   }
 
-  [[maybe_unused]] future<void> state_write_sentry_;
-  {
-    size_t ready_count = 0;
-    for (auto&& [i, row_from, row_to] : s.results) {
-      if (none_of(row_from, row_to, pred_std_isnan)) {
-        s.timeouts[i] = clk_t::time_point::max();
-        ++ready_count;
-      }
+  log_ratings(s, get_data_path(), ratings);
+
+  sort(units.begin(), units.end());
+  units.erase(unique(units.begin(), units.end()), units.end());
+  for (auto u : units)
+    if (s.unit_rated(u)) s.dispatcher.complete(u);
+
+  future<void> state_write;
+  if (s.steady_state())
+    state_write = on_steady_state_outcomes(s);
+  else if (!s.rolling_over()) {
+    // Units cover the cases of the current stage, and those of culled
+    // genomes are complete from the start, so a stage (and the generation
+    // with the last one) is complete once no unit is left.
+    auto stage_complete = [&s]() { return s.dispatcher.unfinished() == 0; };
+
+    while (stage_complete() && s.advance_fidelity()) {
+      SPDLOG_LOGGER_DEBUG(_logger, "Coarse: {} of {} genomes promoted to "
+          "exact evaluation.",
+        s.fidelity.promoted, s.population.size());
     }
 
-    if (ready_count == s.population.size()) {
-      generation_stats stats;
-      next_generation(s, stats);
-      state_write_sentry_ = async(launch::async,
-        [&s] () mutable { persist_state(s); });
+    while (stage_complete() && s.advance_race()) {
+      SPDLOG_LOGGER_DEBUG(_logger, "Racing: cases [{}; {}) of {} are next, "
+          "{} genomes culled so far.",
+        s.race.stage_begin, s.race.stage_end, s.cases.size(),
+        s.race.culled_count);
+    }
 
+    auto complete = stage_complete();
+
+    if (complete && s.rollover.persist.valid())
+      s.rollover.persist.get();
+
+    if (complete && _args.steady_state_flag && !s.popt) {
       SPDLOG_LOGGER_INFO(_logger, "Generation #{} is complete!\n"
-          " Scores: {}; {}.",
-        stats.generation, stats.score_best, stats.score_worst);
+        " Switching to steady-state evolution.", s.generation);
 
-      on_generation_changed(s);
+      begin_steady_state(s);
+    }
+    else if (complete) {
+      s.rollover.pending = true;
+
+      generation_stats stats;
+      collect_stats(s, stats);
+      if (_args.history_flag && s.session == 0) stats.history.emplace();
+      auto top_count = _args.island_peers.empty() || s.session != 0 ? 0
+        : _args.migration_size;
+
+      // Runs on the looper once the next generation is bred.
+      auto end_rollover = [this, &s](generation_stats& stats) {
+        s.rollover.task.get();
+        swap(s.population, s.rollover.population);
+        swap(s.genes_keys, s.rollover.genes_keys);
+        s.generation = s.rollover.generation;
+        s.rollover.pending = false;
+
+        settle_immigrants(s);
+        if (is_migration_due(s)) emigrate(s, move(stats.top));
+
+        // Joined before the population changes again.
+        s.rollover.persist = async(launch::async,
+          [&s, directory = get_data_path()] () mutable {
+            persist_state(s, directory);
+          });
+
+        SPDLOG_LOGGER_INFO(_logger, "Generation #{} is complete!\n"
+            " Scores: {}; {}.\n"
+            " Cache: {}/{} hits ({:.1f}%), {} simulations saved.",
+          stats.generation, stats.score_best, stats.score_worst,
+          stats.cache_hits, stats.cache_lookups,
+          100. * stats.cache_hits / max<size_t>(stats.cache_lookups, 1),
+          stats.simulations_saved);
+        SPDLOG_LOGGER_DEBUG(_logger, " {} duplicate ratings discarded.",
+          stats.ratings_discarded);
+        auto load = server::stats();
+        SPDLOG_LOGGER_INFO(_logger, " Server: {} connections, {} requests "
+            "in flight, {} tasks queued.",
+          load.connections, load.requests_in_flight, load.tasks_queued);
+        if (stats.coarse_promoted) {
+          SPDLOG_LOGGER_INFO(_logger, " Coarse: {} promoted, "
+              "{} simulations saved; rank correlation {:.3f} with exact "
+              "scores.",
+            stats.coarse_promoted, stats.racing_simulations_saved,
+            stats.coarse_rank_corr);
+        }
+        else if (stats.racing_culled) {
+          SPDLOG_LOGGER_INFO(_logger, " Racing: {} culled, "
+              "{} simulations saved.",
+            stats.racing_culled, stats.racing_simulations_saved);
+        }
+        if (!std::isnan(stats.surrogate_rank_corr)) {
+          SPDLOG_LOGGER_INFO(_logger, " Surrogate: rank correlation {:.3f} "
+              "with actual scores of screened children.",
+            stats.surrogate_rank_corr);
+        }
+        if (!_sweep.empty()) report_sweep(s, stats.score_best);
+        if (stats.history) {
+          auto path = _args.history_path;
+          if (path.is_relative()) path = get_data_path(path);
+          _history_write = async(launch::async,
+            [path = move(path), h = move(*stats.history)] {
+              append_history(path, h);
+            });
+        }
+
+        on_generation_changed(s);
+      };
+
+      // Late ratings of the closing generation keep being acknowledged
+      // meanwhile; they're all duplicates by now.
+      s.rollover.task = async(launch::async,
+        [&s, stats, top_count, end_rollover] () mutable {
+          [[maybe_unused]] scope::on_exit rollover_sentry_(
+            [&stats, &end_rollover] {
+              looper::main().post(
+                [stats = move(stats), end_rollover] () mutable {
+                  end_rollover(stats);
+                });
+            });
+
+          s.cache_results();
+          next_generation(s, stats, top_count);
+        });
     }
   }
+  return state_write;
+}
 
+void app::REQUEST_HANDLER_MEM_DECL_(outcomes) {
+  auto in = request.data();
   auto out = google::protobuf::Arena::Create<pb::population>(in->GetArena());
-  {
-    out->set_generation(s.generation);
 
-    DEBUG_(
-      size_t count_resent{};
-    )
+  // Outcomes come in once the population is loaded. Until the results
+  // table is reset too they're kept aside, and no work is handed out;
+  // runners keep asking meanwhile.
+  if (auto results = ready(stage::results); results.valid()
+      && results.wait_for(chrono::seconds(0)) != future_status::ready) {
+    if (in->data_size()) _early_outcomes.emplace_back(*in);
+    out->set_generation(state(stage::population).generation);
+    response.append(out);
+    return;
+  }
+  for (auto& early : exchange(_early_outcomes, {})) take_outcomes(&early);
+
+  [[maybe_unused]] auto state_write_sentry_ = take_outcomes(in);
+  auto now = lease_dispatcher::clock_t::now();
+
+  out->set_generation((in->data_size()
+    ? session_of(in->data(0).genome_id()) : state()).generation);
 
-    auto out_size = in->capacity();
+  // The session that has had the least of the runners so far goes first.
+  auto out_size = in->capacity();
+  for (auto pd : sessions_by_share()) {
+    auto& d = *pd;
     auto out_it = pb::inserter(out->mutable_data());
-    for (auto n = s.population_size; n > 0 && out_size > 0; --n) {
-      using namespace std::chrono_literals;
-      if (now - s.timeouts[s.index] >= results_timeout) {
-
-        DEBUG_(
-          if (s.timeouts[s.index].time_since_epoch().count())
-            ++count_resent;
-        )
-        
-        s.timeouts[s.index] = now;
-        *out_it++ = s.population[s.index];
-        --out_size;
+    auto dispatch = [&d, &out, &out_it, &out_size](size_t u) {
+      *out_it++ = d.population[u / d.units_per_genome];
+      --out_size;
+
+      auto [from, count] = d.unit_block(u);
+      d.simulations_leased += count;
+      if (d.racing() || d.multi_fidelity() || d.units_per_genome > 1) {
+        auto block = out->add_blocks();
+        block->set_start(uint32_t((d.race.offset + from) % d.cases.size()));
+        block->set_count(uint32_t(count));
       }
-      s.index = (s.index + 1) % s.population.size();
+    };
+
+    d.dispatcher.lease(in->client_name(), now, out_size, dispatch);
+
+    if (out_size > 0 && d.speculation_copies > 0 && !d.steady_state()
+        && d.dispatcher.unfinished() <= d.speculation_threshold) {
+      d.dispatcher.for_each_unfinished([&](size_t u) {
+        if (d.dispatcher.leased(u)
+            && !d.dispatcher.leased_to(u, in->client_name())
+            && d.copies[u] < d.speculation_copies) {
+          ++d.copies[u];
+          dispatch(u);
+        }
+        return out_size > 0;
+      });
     }
 
-    DEBUG_(
-      if (count_resent) _logger->debug(
-        "{} individuals resent due to timeout.", count_resent);
-    )
+    if (out->data_size() > 0) {
+      out->set_generation(d.generation);
+      out->set_fidelity(d.coarse() ? pb::FIDELITY_COARSE : pb::FIDELITY_EXACT);
+      break;
+    }
   }
   response.append(out);
 }
@@ -14,6 +14,8 @@
 #include <iostream>
 #include <sstream>
 
+#include <unistd.h>
+
 namespace marslander::trainer {
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(algorithm_args,
@@ -35,11 +37,37 @@ void app_args::parse_replay_optarg(const std::string& optarg,
 }
 
 void app::do_dump_session() {
-  auto& s = state();
+  auto& s = state(stage::population);
+
+  bool standard_out = true;
+  std::ostream* dst = &std::cout;
+  auto file_path = _args.dump_session_path;
+  if (!file_path.empty() && file_path.is_relative())
+    file_path = get_data_path(file_path);
+  ofstream dstf_(file_path);
+  if (dstf_) {
+    standard_out = false;
+    dst = &dstf_;
+  }
+  else if (!_args.dump_session_path.empty()) {
+    cerr << "Can't write a session dump into " << _args.dump_session_path
+      << endl;
+    _last_error = -2;
+    return;
+  }
+
+  // Records still mapped are parsed one at a time as they're written, so
+  // the dump takes constant extra memory; otherwise it's written off the
+  // loaded session.
+  auto& mapped = s.mapped;
+  auto pop_count = mapped.file ? mapped.population.size()
+    : s.population.size();
 
-  auto pop_sz = s.population.size();
+  // The dump is streamed, so its size only matters to whoever reads it:
+  // sampling is offered when it would flood a terminal.
+  auto pop_sz = pop_count;
   constexpr auto size_threshold = 1000;
-  while (pop_sz > size_threshold) {
+  while (standard_out && isatty(STDOUT_FILENO) && pop_sz > size_threshold) {
     cout << "Population output gotta be HUGE ("
       << pop_sz << " entries)!\n"
   "Would you like to specify a number of population "
@@ -50,7 +78,7 @@ void app::do_dump_session() {
 
     if (!wait_answer(answers::yes_y)) break;
 
-    pop_sz = s.population.size();
+    pop_sz = pop_count;
     unit_value sample_units{};
     read_input(
       fmt::format("Population samples count [{}]:",
@@ -63,66 +91,66 @@ void app::do_dump_session() {
       cout << pop_sz << " population entries." << endl;
   }
 
-  std::vector<data::landing_case> json_cases(s.cases.size());
-  for (size_t i = 0, imax = json_cases.size(); i < imax; ++i)
-    convert_back(s.cases[i], json_cases[i]);
-
-  std::vector<data::genome> json_population(pop_sz);
-  if (pop_sz < s.population.size()) {
-    vector<size_t> inds; inds.reserve(pop_sz);
-    uniform_int_distribution<size_t> d{0, s.population.size()-1};
+  vector<size_t> inds;
+  if (pop_sz < pop_count) {
+    inds.reserve(pop_sz);
+    uniform_int_distribution<size_t> d{0, pop_count-1};
     while (inds.size() < pop_sz) {
       auto i = d(*s.prng);
       auto inds_it = lower_bound(inds.begin(), inds.end(), i);
       if (inds_it == inds.end() || i < *inds_it)
         inds.insert(inds_it, i);
     }
-
-    size_t j = 0;
-    for (auto i : inds)
-      convert_back(s.population[i], json_population[j++]);
-  }
-  else {
-    for (size_t i = 0, imax = json_population.size(); i < imax; ++i)
-      convert_back(s.population[i], json_population[i]);
   }
 
-  bool standard_out = true;
-  std::ostream* dst = &std::cout;
-  auto file_path = _args.dump_session_path;
-  if (!file_path.empty() && file_path.is_relative())
-    file_path = get_data_path(file_path);
-  ofstream dstf_(file_path);
-  if (dstf_) {
-    standard_out = false;
-    dst = &dstf_;
+  // Fields go in the order json::dump sorts them in.
+  json_stream js(*dst, standard_out ? 2 : -1);
+  js.begin_object().key("cases").begin_array();
+  data::landing_case json_case;
+  auto put_case = [&](const pb::landing_case& c) {
+    convert_back(c, json_case);
+    js.value(json_case);
+  };
+  if (mapped.file) {
+    pb::landing_case c;
+    for (size_t i = 0; i < mapped.cases.size(); ++i)
+      if (mapped.cases.read(i, c)) put_case(c);
   }
-  else if (!_args.dump_session_path.empty()) {
-    cerr << "Can't write a session dump into " << _args.dump_session_path
-      << endl;
-    _last_error = -2;
-    return;
+  else for (auto& c : s.cases) put_case(c);
+  js.end_array()
+    .field("cases_count", s.cases_count)
+    .field("check", s.check)
+    .field("crossover", s.crossover)
+    .field("elite_count", s.elite_count)
+    .field("generation", s.generation)
+    .field("mutation", s.mutation)
+    .key("population").begin_array();
+  data::genome json_genome;
+  auto put_genome = [&](const pb::genome& g) {
+    convert_back(g, json_genome);
+    js.value(json_genome);
+  };
+  if (mapped.file) {
+    pb::genome g;
+    auto put_mapped = [&](size_t i) {
+      if (mapped.population.read(i, g)) put_genome(g);
+    };
+    if (inds.empty()) for (size_t i = 0; i < pop_count; ++i) put_mapped(i);
+    else for (auto i : inds) put_mapped(i);
   }
-
-  if (standard_out) (*dst) << PRETTY_JSON;
-  (*dst) << JSON_SESSION_DUMP(
-    s.check,
-    s.generation,
-    s.cases_count,
-    s.population_size,
-    s.elite_count,
-    s.tournament_size,
-    s.crossover,
-    s.mutation,
-    json_cases,
-    json_population);
+  else if (inds.empty()) for (auto& g : s.population) put_genome(g);
+  else for (auto i : inds) put_genome(s.population[i]);
+  js.end_array()
+    .field("population_size", s.population_size)
+    .field("tournament_size", s.tournament_size)
+  .end_object();
 
   if (standard_out) cout << endl;
   cout << "Done dumping the session." << endl;
 }
  
 void app::do_make_replay() {
-  auto& s = state();
+  auto& s = state(stage::population);
 
   uid_t case_id = _args.replay_case_id,
         gene_id = _args.replay_gene_id;
@@ -146,8 +174,8 @@ void app::do_make_replay() {
   }
   else cout << "Case ID:   " << case_id << endl;
 
-  auto case_ind = s.cases_index.find(case_id);
-  if (may_swap_ids && case_ind == s.cases_index.end()) {
+  auto pcase = s.find_case(case_id);
+  if (may_swap_ids && !pcase) {
     cout << "Hmm, Case with ID " << case_id << " is not found;"
   " Let us swap incoming IDs and try again." << endl << endl;
 
@@ -155,16 +183,16 @@ void app::do_make_replay() {
     cout << "Genome ID: " << gene_id << endl;
     cout << "Case ID:   " << case_id << endl;
 
-    case_ind = s.cases_index.find(case_id);
+    pcase = s.find_case(case_id);
   }
-  if (case_ind == s.cases_index.end()) {
+  if (!pcase) {
     cerr << "There is no Case with ID " << _args.replay_case_id << endl;
     _last_error = -1;
     return;
   }
 
-  auto population_ind = s.population_index.find(gene_id);
-  if (population_ind == s.population_index.end()){
+  auto pgenome = s.find_genome(gene_id);
+  if (!pgenome) {
     cerr << "There is no Genome with ID " << gene_id << endl;
     _last_error = -1;
     return;
@@ -172,8 +200,9 @@ void app::do_make_replay() {
 
   using brain_t = nn::DFF<fnum>;
 
-  auto sim_state{move(data::convert(*case_ind->second).second)};
-  auto brain{move(data::convert_f<brain_t::value_type>{}(*population_ind->second).second)};
+  auto sim_state{move(data::convert(*pcase).second)};
+  auto brain{move(data::convert_f<brain_t::value_type>{}(
+    *pgenome).second)};
   nn::game_adapter a(brain, sim_state, sim_state);
 
   using turns_t = std::vector<game_turn_input>;
@@ -208,14 +237,16 @@ void app::do_make_replay() {
     return;
   }
 
-  dstf_ << PRETTY_JSON
-  << JSON_REPLAY(
-    case_id,
-    gene_id,
-    o,
-    sim_state_base64,
-    forward<game_init_input>(sim_state),
-    turns);
+  json_stream js(dstf_, 2);
+  js.begin_object()
+    .field("case_id", case_id)
+    .field("gene_id", gene_id)
+    .field("outcome", o)
+    .field("state", sim_state_base64)
+    .field("surface", static_cast<const game_init_input&>(sim_state))
+    .key("turns").begin_array();
+  for (auto& turn : turns) js.value(turn);
+  js.end_array().end_object();
 
   cout << "Done exporting the replay." << endl;
 }
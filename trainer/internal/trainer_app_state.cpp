@@ -1,37 +1,71 @@
 #include "trainer_app.h"
 
+#include <algorithm>
+#include <cassert>
+#include <execution>
+#include <limits>
+
 namespace marslander::trainer {
 
+using namespace std;
+
 void app_state::rebuild_indices() {
 
   DEBUG_(
     auto logger = spdlog::get(loggers::trainer_logger);
     )
 
-  cases_index.clear();
-  for (auto& item : cases) {
-    DEBUG_(
-      auto result =
-      )
-    cases_index.insert({item.id(), {cases_index.size(), item}});
-
-    DEBUG_(
-        if (!result.second)
-          logger->debug("Cases index conflict! ID: {} ", item.id());
-      )
+  cases_index.rebuild(cases.begin(), cases.end());
+
+  DEBUG_(
+    if (cases_index.size() != cases.size())
+      logger->debug("Cases index conflict! {} of {} IDs are unique.",
+        cases_index.size(), cases.size());
+    )
+
+  population_index.rebuild(population.begin(), population.end());
+
+  DEBUG_(
+    if (population_index.size() != population.size())
+      logger->debug("Population index conflict! {} of {} IDs are unique.",
+        population_index.size(), population.size());
+    )
+}
+
+void app_state::hash_genes() {
+  genes_keys.resize(population.size());
+  transform(execution::par_unseq,
+    population.begin(), population.end(), genes_keys.begin(),
+    &fitness_cache::hash);
+}
+
+// Genes are keyed already, see genes_keys.
+void app_state::reset_results() {
+  assert(genes_keys.size() == population.size());
+  results.resize(cases.size(), population.size(),
+      std::numeric_limits<decltype(results)::value_type>::quiet_NaN());
+
+  ratings_discarded = 0;
+
+  cache_hits = 0;
+  for (size_t i = 0, imax = population.size(); i < imax; ++i) {
+    auto ratings = cache.find(genes_keys[i], population[i]);
+    if (!ratings || ratings->size() != cases.size()) continue;
+
+    copy(ratings->begin(), ratings->end(), results[i]);
+    ++cache_hits;
   }
 
-  population_index.clear();
-  for (auto& item : population) {
-    DEBUG_(
-      auto result =
-      )
-    population_index.insert({item.id(), {population_index.size(), item}});
-
-    DEBUG_(
-        if (!result.second)
-          logger->debug("Population index conflict! ID: {} ", item.id());
-      )
+  begin_race();
+  begin_fidelity();
+  reset_units();
+}
+
+void app_state::cache_results() {
+  // Rows of culled genomes are partly made up, so they're not cached.
+  for (auto&& [i, row_from, row_to] : results) {
+    if (i < race.culled.size() && race.culled[i]) continue;
+    cache.insert(genes_keys[i], population[i], row_from, row_to);
   }
 }
 
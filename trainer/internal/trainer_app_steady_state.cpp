@@ -0,0 +1,196 @@
+#include "trainer_app.h"
+#include "trainer_input.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <string>
+
+namespace marslander::trainer {
+
+using namespace std;
+
+bool app_args::parse_steady_state_optarg(const string& optarg) {
+  using namespace marslander::input;
+  constexpr auto ul_max_ = numeric_limits<unsigned long>::max();
+
+  unsigned long evals;
+  if (!cvt_num_ul(optarg, evals, 0, ul_max_, 0)) return false;
+
+  steady_state_persist_cadence = evals;
+  return true;
+}
+
+namespace {
+
+// NOTE: fast_sum works in place, so the row is spoiled afterwards.
+score_t row_score(results_table& results, size_t i) {
+  auto row = results[i];
+  return fp::fast_sum(row, row + results.cols()) / results.cols();
+}
+
+// The first child is written into the offspring slot; surplus children
+// of multi-child crossovers are dropped into a spare genome.
+class offspring_query final : public child_output_query<pb::genome> {
+  pb::genome *_child, *_spare;
+public:
+  offspring_query(pb::genome& child, pb::genome& spare)
+    : _child{&child}, _spare{&spare} {}
+  pb::genome& next_child() override {
+    return *std::exchange(_child, _spare);
+  }
+};
+
+void reindex(app_state& s, size_t i) {
+  auto& item = s.population[i];
+  s.population_index.erase(item.id());
+  s.population_index.insert(item.id(), id_directory::pos_type(i));
+}
+
+// Breeds a new child into offspring slot j; returns true when its ratings
+// were resolved from the fitness cache and it needs no evaluation.
+bool breed(app_state& s, size_t j) {
+  auto& child = s.population[j];
+  s.population_index.erase(child.id());
+
+  bool immigrant = !s.immigrants.empty();
+  if (immigrant) {
+    child = move(s.immigrants.front());
+    s.immigrants.pop_front();
+  }
+  else if (s.pxvr) {
+    auto x1 = s.pool_sel->exec(), x2 = s.pool_sel->exec();
+    offspring_query q{child, s.offspring_spare};
+    s.pxvr->exec(s.population[x1], s.population[x2], q,
+      int(s.scores[x1] > s.scores[x2]) - int(s.scores[x1] < s.scores[x2]));
+  }
+  else child = s.population[s.pool_sel->exec()];
+
+  if (!immigrant) s.pmtn->exec(child);
+  child.set_id(s.uids.next_uid());
+  s.population_index.insert(child.id(), id_directory::pos_type(j));
+
+  auto row = s.results[j];
+  fill(row, row + s.results.cols(),
+    numeric_limits<results_table::value_type>::quiet_NaN());
+
+  s.genes_keys[j] = fitness_cache::hash(child);
+  auto ratings = s.cache.find(s.genes_keys[j], child);
+  if (!ratings || ratings->size() != s.results.cols()) {
+    s.ready_units(j);
+    return false;
+  }
+
+  copy(ratings->begin(), ratings->end(), row);
+  s.complete_units(j);
+  ++s.cache_hits;
+  return true;
+}
+
+} // namespace
+
+void app::begin_steady_state(app_state& s) {
+  auto pool_size = s.population_size;
+  assert(s.population.size() == pool_size);
+
+  s.cache_results();
+  s.scores.resize(pool_size);
+  for (size_t i = 0; i < pool_size; ++i)
+    s.scores[i] = row_score(s.results, i);
+  s.pool_sel = make_unique<algo::sel::tournament<app_state::random_engine_t>>(
+    s.prng, s.tournament_size);
+  s.pool_sel->prepare(s.scores);
+
+  auto offspring_count = max<size_t>(
+    pool_size - min(s.elite_count, pool_size), 1);
+  s.population.resize(pool_size + offspring_count);
+  s.genes_keys.resize(s.population.size());
+  s.rebuild_indices();
+  s.reset_results();
+  s.evaluations = 0;
+
+  for (size_t i = 0; i < pool_size; ++i) s.complete_units(i);
+
+  s.cache_hits = 0;
+  for (size_t j = pool_size; j < s.population.size(); ++j)
+    breed(s, j);
+}
+
+// The ratings of offspring j are remembered; then it takes the place of
+// the worst individual of the pool, when it scores better.
+void app::replace_worst(app_state& s, size_t j) {
+  auto row = s.results[j];
+  s.cache.insert(s.genes_keys[j], s.population[j],
+    row, row + s.results.cols());
+  auto score = row_score(s.results, j);
+
+  auto w = distance(s.scores.begin(),
+    max_element(s.scores.begin(), s.scores.end()));
+  if (score < s.scores[w]) {
+    swap(s.population[w], s.population[j]);
+    swap(s.genes_keys[w], s.genes_keys[j]);
+    s.scores[w] = score;
+    s.pool_sel->prepare(s.scores);
+    reindex(s, w);
+    reindex(s, j);
+  }
+}
+
+future<void> app::on_steady_state_outcomes(app_state& s) {
+  auto pool_size = s.population_size;
+  auto epoch_size = max<size_t>(pool_size, 1);
+  auto persist_cadence = _args.steady_state_persist_cadence > 0
+    ? _args.steady_state_persist_cadence : epoch_size;
+
+  bool persist = false;
+  for (auto j = pool_size, jmax = s.population.size(); j < jmax; ++j) {
+    // A cache hit completes the new child at once; bounded by the
+    // offspring count so that a run of duplicates can't stall the looper.
+    for (auto n = jmax - pool_size; n > 0; --n) {
+      auto row = s.results[j];
+      if (any_of(row, row + s.results.cols(), pred_std_isnan)) break;
+
+      replace_worst(s, j);
+      ++s.evaluations;
+      persist |= s.evaluations % persist_cadence == 0;
+
+      if (s.evaluations % epoch_size == 0) {
+        auto [best, worst] = minmax_element(s.scores.begin(), s.scores.end());
+        SPDLOG_LOGGER_INFO(_logger, "Generation #{} is complete!\n"
+            " Scores: {}; {}.\n"
+            " Cache: {} hits, {} simulations saved.",
+          s.generation, *best, *worst,
+          s.cache_hits, s.cache_hits * s.cases.size());
+
+        s.generation += 1;
+        s.cache_hits = 0;
+
+        if (is_migration_due(s)) {
+          vector<size_t> inds(pool_size);
+          iota(inds.begin(), inds.end(), 0);
+          auto top_count = min(_args.migration_size, pool_size);
+          partial_sort(inds.begin(), next(inds.begin(), top_count), inds.end(),
+            [&s](auto u, auto v) { return s.scores[u] < s.scores[v]; });
+
+          app_state::population_t top;
+          for (size_t i = 0; i < top_count; ++i)
+            top.push_back(s.population[inds[i]]);
+          emigrate(s, move(top));
+        }
+      }
+
+      if (!breed(s, j)) break;
+    }
+  }
+
+  if (!persist) return {};
+  return async(launch::async, [&s, directory = get_data_path()] () mutable {
+    persist_state(s, directory);
+  });
+}
+
+} // namespace marslander::trainer
@@ -0,0 +1,86 @@
+#include "trainer_app.h"
+#include "trainer_input.h"
+
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <string>
+
+namespace marslander::trainer {
+
+using namespace std;
+
+bool app_args::parse_surrogate_optarg(const string& optarg) {
+  using namespace marslander::input;
+  constexpr auto dbl_max_ = numeric_limits<double>::max();
+
+  auto tokens = split(optarg, string(";"), true);
+  if (tokens.empty() || tokens.size() > 2) return false;
+
+  double factor, lambda = surrogate_lambda;
+  if (!cvt_num_dbl(tokens[0], factor, 0, dbl_max_, 0)) return false;
+  if (tokens.size() > 1 && !cvt_num_dbl(tokens[1], lambda, 0, dbl_max_, lambda))
+    return false;
+
+  surrogate_factor = factor;
+  surrogate_lambda = lambda;
+  return true;
+}
+
+// Feeds scores of the evaluated population to the surrogate and refits it;
+// returns the rank correlation of scores predicted for the screened
+// children with the actual ones (NaN if there were none).
+double app_state::observe_scores(const vector<score_t>& score) {
+  if (surrogate_factor <= 1) return numeric_limits<double>::quiet_NaN();
+
+  auto is_culled = [this](size_t i) {
+    return i < race.culled.size() && race.culled[i];
+  };
+
+  vector<score_t> predicted, actual;
+  for (size_t i = 0, imax = min(predictions.size(), score.size());
+      i < imax; ++i) {
+    if (std::isnan(predictions[i]) || is_culled(i)) continue;
+    predicted.push_back(predictions[i]);
+    actual.push_back(score[i]);
+  }
+
+  // Elites carried over were observed in the previous generations.
+  auto carried = generation > 0 ? min(elite_count, score.size()) : 0;
+  for (auto i = carried, imax = score.size(); i < imax; ++i)
+    if (!is_culled(i)) surrogate.observe(population[i], score[i]);
+  surrogate.fit(surrogate_lambda);
+
+  predictions.assign(population_size, numeric_limits<score_t>::quiet_NaN());
+  return rank_correlation(predicted, actual);
+}
+
+// Moves `count` children with the best predicted scores to the beginning
+// of pool[from; end) range.
+void app_state::screen_offspring(population_t& pool, size_t from,
+    size_t count) {
+  auto children = next(pool.begin(), from);
+  vector<score_t> predicted(distance(children, pool.end()));
+  transform(execution::par_unseq, children, pool.end(), predicted.begin(),
+    [this](auto& g) { return surrogate.predict(g); });
+
+  count = min(count, predicted.size());
+  vector<size_t> inds(predicted.size());
+  iota(inds.begin(), inds.end(), 0);
+  partial_sort(inds.begin(), next(inds.begin(), count), inds.end(),
+    [&predicted](auto u, auto v) { return predicted[u] < predicted[v]; });
+
+  population_t best;
+  best.reserve(count);
+  for (size_t k = 0; k < count; ++k) {
+    best.push_back(move(children[inds[k]]));
+    if (from + k < predictions.size())
+      predictions[from + k] = predicted[inds[k]];
+  }
+  move(best.begin(), best.end(), children);
+}
+
+} // namespace marslander::trainer
@@ -0,0 +1,73 @@
+#include "trainer_app.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+namespace marslander::trainer {
+
+using namespace std;
+
+namespace {
+
+constexpr char sweep_filename[] = "sweep.csv";
+
+string describe(const algorithm_args& args) {
+  auto r = args.name;
+  for (auto v : args.values) r += fmt::format(";{}", v);
+  return r;
+}
+
+string describe(const app_state& s) {
+  return fmt::format("p={} e={} s={} x={} m={}",
+    s.population_size, s.elite_count, describe(s.selection),
+    describe(s.crossover), describe(s.mutation));
+}
+
+} // namespace
+
+app_state& app::session_of(uid_t genome_id) {
+  auto& s = state();
+  for (auto& p : _sweep)
+    if (p->population_index.find(genome_id) != id_directory::npos) return *p;
+  return s;
+}
+
+// Fair share: runners are given to the session that has had the fewest
+// simulations leased so far and has anything to run.
+vector<app_state*> app::sessions_by_share() {
+  vector<app_state*> r{&state()};
+  for (auto& p : _sweep) r.push_back(p.get());
+  stable_sort(r.begin(), r.end(), [](auto u, auto v) {
+    return u->simulations_leased < v->simulations_leased;
+  });
+  return r;
+}
+
+// Appends the progress of a session to sweep.csv and logs the standings.
+void app::report_sweep(app_state& s, score_t best) {
+  s.best_score = min(s.best_score, best);
+
+  {
+    ofstream f(get_data_path(sweep_filename), ios_base::app);
+    f << s.session << ',' << s.generation << ',' << s.simulations_leased
+      << ',' << s.best_score << ",\"" << describe(s) << "\"\n";
+  }
+
+  vector<const app_state*> sessions{&_state};
+  for (auto& p : _sweep) sessions.push_back(p.get());
+  sort(sessions.begin(), sessions.end(), [](auto u, auto v) {
+    return u->best_score < v->best_score;
+  });
+
+  string table;
+  for (auto p : sessions) {
+    table += fmt::format("\n {:>3} {:>6} {:>12} {:>14} {}",
+      p->session, p->generation, p->simulations_leased, p->best_score,
+      describe(*p));
+  }
+  SPDLOG_LOGGER_INFO(_logger, "Sweep standings (session, generation, "
+    "simulations, best score, configuration):{}", table);
+}
+
+} // namespace marslander::trainer
@@ -0,0 +1,89 @@
+#include "trainer_app.h"
+#include "trainer_input.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+
+namespace marslander::trainer {
+
+using namespace std;
+
+bool app_args::parse_work_unit_optarg(const string& optarg) {
+  using namespace marslander::input;
+  constexpr auto ul_max_ = numeric_limits<unsigned long>::max();
+
+  unsigned long ms;
+  if (!cvt_num_ul(optarg, ms, 0, ul_max_, 0)) return false;
+
+  work_unit_ms = ms;
+  return true;
+}
+
+void app_state::reset_units() {
+  auto window = race.stage_end - race.stage_begin;
+
+  units_per_genome = 1;
+  auto simulation_time = dispatcher.simulation_time();
+  if (unit_time > unit_time.zero() && simulation_time > unit_time.zero()) {
+    auto genome_time = simulation_time * window;
+    units_per_genome = clamp<size_t>(genome_time / unit_time, 1,
+      max<size_t>(window, 1));
+  }
+
+  dispatcher.reset(population.size() * units_per_genome);
+  copies.assign(dispatcher.size(), 0);
+  for (size_t u = 0, umax = dispatcher.size(); u < umax; ++u) {
+    auto i = u / units_per_genome;
+    if ((i < race.culled.size() && race.culled[i]) || unit_rated(u)
+        || (coarse() && fidelity.exact_rated[i]))
+      dispatcher.complete(u);
+  }
+}
+
+void app_state::ready_units(size_t i) {
+  for (auto u = i * units_per_genome, umax = u + units_per_genome;
+      u < umax; ++u)
+    if (!unit_rated(u)) dispatcher.make_ready(u);
+}
+
+void app_state::complete_units(size_t i) {
+  for (auto u = i * units_per_genome, umax = u + units_per_genome;
+      u < umax; ++u)
+    dispatcher.complete(u);
+}
+
+// Returns the block of cases of a unit relative to race.offset.
+pair<size_t, size_t> app_state::unit_block(size_t u) const {
+  auto b = u % units_per_genome;
+  auto window = race.stage_end - race.stage_begin;
+  auto from = race.stage_begin + b * window / units_per_genome;
+  auto to = race.stage_begin + (b + 1) * window / units_per_genome;
+  return {from, to - from};
+}
+
+size_t app_state::unit_of(size_t i, size_t case_ind) const {
+  auto n = cases.size();
+  auto k = (case_ind + n - race.offset % n) % n;
+  if (k < race.stage_begin || k >= race.stage_end)
+    return numeric_limits<size_t>::max();
+
+  auto window = race.stage_end - race.stage_begin;
+  auto r = k - race.stage_begin;
+  auto b = r * units_per_genome / window;
+  while (b > 0 && b * window / units_per_genome > r) --b;
+  while ((b + 1) * window / units_per_genome <= r) ++b;
+  return i * units_per_genome + b;
+}
+
+bool app_state::unit_rated(size_t u) {
+  auto row = (coarse() ? fidelity.results : results)[u / units_per_genome];
+  auto n = cases.size();
+  auto [from, count] = unit_block(u);
+  for (auto k = from, kmax = from + count; k < kmax; ++k)
+    if (std::isnan(row[(race.offset + k) % n])) return false;
+  return true;
+}
+
+} // namespace marslander::trainer
@@ -5,7 +5,9 @@
 
 #include "nlohmann/json.hpp"
 
+#include <filesystem>
 #include <fstream>
+#include <vector>
 
 namespace marslander::data {
 
@@ -46,6 +48,11 @@ void convert(const landing_case& src, pb::landing_case& dst);
 void convert_back(const pb::genome& src, genome& dst);
 void convert_back(const pb::landing_case& src, landing_case& dst);
 
+// Reads predefined cases from a JSON array of them, from case objects one
+// per line, or from the text layout of test_cases.txt; cases are parsed
+// one at a time, with no document built up in memory.
+std::vector<pb::landing_case> import_cases(const std::filesystem::path&);
+
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(genome,
   id, genes);
 
@@ -0,0 +1,285 @@
+#include "trainer_data.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace marslander::data {
+
+using namespace std;
+using namespace nlohmann;
+
+namespace {
+
+// Builds cases right from the parser events: a JSON array of cases, or
+// any number of case objects one after another (one per line, usually).
+// Unknown fields, such as "name", are skipped.
+class cases_sax final : public json_sax<json> {
+
+  struct frame {
+    bool array;
+    std::string key;
+  };
+
+  vector<pb::landing_case>& _cases;
+  vector<frame> _frames;
+  size_t _case_level;
+  pb::point_int32* _point;
+
+  bool in_case(size_t depth) const {
+    return _frames.size() == _case_level + depth + 1
+      && !_frames[_case_level].array;
+  }
+
+  const std::string& key_at(size_t depth) const {
+    return _frames[_case_level + depth].key;
+  }
+
+  bool set(double v) {
+    if (_frames.empty() || _frames.size() <= _case_level) return true;
+
+    auto& c = _cases.back();
+    if (in_case(0)) {
+      auto& k = key_at(0);
+      if (k == "id") c.set_id(uid_t(v));
+      else if (k == "fuel") c.set_fuel(int32_t(v));
+      else if (k == "thrust") c.set_thrust(int32_t(v));
+      else if (k == "tilt") c.set_tilt(int32_t(v));
+    }
+    else if (in_case(1) && !_frames.back().array) {
+      auto& k0 = key_at(0);
+      auto& k = key_at(1);
+      if (k0 == "safe_area") {
+        if (k == "start") c.mutable_safe_area()->set_start(int32_t(v));
+        else if (k == "end") c.mutable_safe_area()->set_end(int32_t(v));
+      }
+      else if (k0 == "position") {
+        if (k == "x") c.mutable_position()->set_x(int32_t(v));
+        else if (k == "y") c.mutable_position()->set_y(int32_t(v));
+      }
+      else if (k0 == "velocity") {
+        if (k == "x") c.mutable_velocity()->set_x(v);
+        else if (k == "y") c.mutable_velocity()->set_y(v);
+      }
+    }
+    else if (in_case(2) && _point) {
+      auto& k = key_at(2);
+      if (k == "x") _point->set_x(int32_t(v));
+      else if (k == "y") _point->set_y(int32_t(v));
+    }
+    return true;
+  }
+
+  bool open(bool array) {
+    if (_frames.empty()) _case_level = array ? 1 : 0;
+    if (_frames.size() == _case_level && !array) _cases.emplace_back();
+    if (in_case(1) && !array && key_at(0) == "surface"
+        && _frames.back().array)
+      _point = _cases.back().add_surface();
+    _frames.push_back({array, {}});
+    return true;
+  }
+
+  bool close() {
+    _frames.pop_back();
+    if (in_case(1)) _point = nullptr;
+    return true;
+  }
+
+public:
+
+  explicit cases_sax(vector<pb::landing_case>& cases)
+    : _cases{cases}, _case_level{}, _point{} {}
+
+  bool null() override { return true; }
+  bool boolean(bool) override { return true; }
+  bool number_integer(number_integer_t v) override { return set(double(v)); }
+  bool number_unsigned(number_unsigned_t v) override {
+    return set(double(v));
+  }
+  bool number_float(number_float_t v, const string_t&) override {
+    return set(v);
+  }
+  bool string(string_t&) override { return true; }
+  bool binary(binary_t&) override { return true; }
+
+  bool start_object(size_t) override { return open(false); }
+  bool end_object() override { return close(); }
+  bool start_array(size_t) override { return open(true); }
+  bool end_array() override { return close(); }
+
+  bool key(string_t& k) override {
+    _frames.back().key = move(k);
+    return true;
+  }
+
+  bool parse_error(size_t position, const std::string&,
+      const detail::exception& e) override {
+    throw runtime_error("Malformed cases file at byte "
+      + to_string(position) + ": " + e.what());
+  }
+
+};
+
+// Numbers of a line of the text layout, in order of appearance.
+vector<double> numbers_of(const std::string& line) {
+  vector<double> result;
+  for (auto p = line.c_str(); *p;) {
+    if (!isdigit(uint8_t(*p))
+        && !(*p == '-' && isdigit(uint8_t(p[1])))) { ++p; continue; }
+    char* end;
+    result.push_back(strtod(p, &end));
+    p = end;
+  }
+  return result;
+}
+
+bool starts_with(const char* s, const char* prefix) {
+  return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+// The text layout of test_cases.txt, in either of its flavours:
+//
+//   # Easy on the right
+//   landscape: [{0; 100}, {1000; 500}, ...]
+//   position: 2500; 2700 hspeed: 0 vspeed: 0 fuel: 550 tile: 0 thrust: 0
+//   flat surface: { {4000; 150}; {5500; 150} }
+//
+// or tab-separated, X and Y rows of the landscape followed by a row with
+// ^ under the ends of the flat surface, then the position header and a
+// row of its values. A case is complete once all of its parts are read.
+void read_text(istream& is, vector<pb::landing_case>& cases) {
+  vector<double> xs, ys, values;
+  int safe_start = -1, safe_end = -1;
+  pair<double, double> flat[2];
+  bool has_flat = false, values_follow = false;
+  size_t line_no = 0;
+
+  auto fail = [&line_no](const char* what) {
+    throw runtime_error("Malformed cases file at line "
+      + to_string(line_no) + ": " + what);
+  };
+
+  auto pending = [&]() {
+    return !xs.empty() || !values.empty() || has_flat || safe_start >= 0;
+  };
+
+  auto try_complete = [&]() {
+    if (xs.empty() || values.empty() || (!has_flat && safe_start < 0))
+      return;
+    if (ys.size() != xs.size()) fail("the landscape has no Y row");
+
+    if (has_flat) {
+      for (size_t i = 0; i < xs.size(); ++i) {
+        if (xs[i] == flat[0].first && ys[i] == flat[0].second)
+          safe_start = int(i);
+        if (xs[i] == flat[1].first && ys[i] == flat[1].second)
+          safe_end = int(i);
+      }
+    }
+    if (safe_start < 0 || safe_end <= safe_start
+        || size_t(safe_end) >= xs.size())
+      fail("the flat surface is not a part of the landscape");
+
+    auto& c = cases.emplace_back();
+    c.mutable_position()->set_x(int32_t(values[0]));
+    c.mutable_position()->set_y(int32_t(values[1]));
+    c.mutable_velocity()->set_x(values[2]);
+    c.mutable_velocity()->set_y(values[3]);
+    c.set_fuel(int32_t(values[4]));
+    c.set_tilt(int32_t(values[5]));
+    c.set_thrust(int32_t(values[6]));
+    c.mutable_safe_area()->set_start(safe_start);
+    c.mutable_safe_area()->set_end(safe_end);
+    auto surface = c.mutable_surface();
+    surface->Reserve(int(xs.size()));
+    for (size_t i = 0; i < xs.size(); ++i) {
+      auto p = surface->Add();
+      p->set_x(int32_t(xs[i]));
+      p->set_y(int32_t(ys[i]));
+    }
+
+    xs.clear(); ys.clear(); values.clear();
+    safe_start = safe_end = -1;
+    has_flat = false;
+  };
+
+  for (std::string line; getline(is, line);) {
+    ++line_no;
+    auto first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line.compare(first, 2, "//") == 0)
+      continue;
+
+    auto nums = numbers_of(line);
+    auto text = line.c_str() + first;
+    if (values_follow) {
+      values_follow = false;
+      if (nums.size() != 7) fail("expected 7 position values");
+      values = move(nums);
+    }
+    else if (line[first] == '#') {
+      if (pending()) fail("the previous case is incomplete");
+    }
+    else if (starts_with(text, "landscape:")) {
+      if (nums.size() % 2) fail("odd number of landscape coordinates");
+      xs.clear(); ys.clear();
+      for (size_t i = 0; i < nums.size(); i += 2) {
+        xs.push_back(nums[i]);
+        ys.push_back(nums[i + 1]);
+      }
+    }
+    else if (starts_with(text, "X\t")) xs = move(nums);
+    else if (starts_with(text, "Y\t")) {
+      if (nums.size() != xs.size()) fail("X and Y rows differ in length");
+      ys = move(nums);
+    }
+    else if (line.find('^') != std::string::npos) {
+      // Column 0 of the rows above holds X and Y.
+      int column = 0;
+      for (auto ch : line) {
+        if (ch == '\t') ++column;
+        else if (ch == '^') (safe_start < 0 ? safe_start : safe_end)
+          = column - 1;
+      }
+    }
+    else if (starts_with(text, "position:")) {
+      if (nums.empty()) values_follow = true;
+      else if (nums.size() != 7) fail("expected 7 position values");
+      else values = move(nums);
+    }
+    else if (starts_with(text, "flat surface:")) {
+      if (nums.size() != 4) fail("expected 2 flat surface points");
+      flat[0] = {nums[0], nums[1]};
+      flat[1] = {nums[2], nums[3]};
+      has_flat = true;
+    }
+    else fail("unknown line");
+
+    try_complete();
+  }
+
+  if (pending() || values_follow) fail("the last case is incomplete");
+}
+
+} // namespace
+
+vector<pb::landing_case> import_cases(const filesystem::path& path) {
+  ifstream is(path);
+  if (!is) throw runtime_error("Can't open cases file " + path.string());
+
+  vector<pb::landing_case> cases;
+  if (is >> ws; is.peek() != '[' && is.peek() != '{') {
+    read_text(is, cases);
+    return cases;
+  }
+
+  cases_sax sax(cases);
+  while (is >> ws, is.peek() != char_traits<char>::eof())
+    json::sax_parse(is, &sax, json::input_format_t::json, false);
+  return cases;
+}
+
+} // namespace marslander::data
@@ -1,3 +1,8 @@
+#pragma once
+
+#ifndef TRAINER_INTERNAL_TRAINER_INPUT_H_
+#define TRAINER_INTERNAL_TRAINER_INPUT_H_
+
 #include "global_includes.h"
 
 #include <algorithm>
@@ -30,3 +35,5 @@ static inline bool cvt_alg_args(const std::string& s, trainer::algorithm_args& r
 }
 
 } // namespace marslander::input
+
+#endif // TRAINER_INTERNAL_TRAINER_INPUT_H_
@@ -4,7 +4,9 @@
 #include "sockpp/socket.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
 
+#include <exception>
 #include <iostream>
+#include <random>
 
 #include <getopt.h>
 #include <string.h>
@@ -42,7 +44,9 @@ void help(pcstr name) {
 "  --init[=cases/file/path]   Requires to begin training process from the very\n"
 "                             beginning; A population is to be created from\n"
 "                             scratch. User may specify a path leading to a file\n"
-"                             with predefined training cases.\n"
+"                             with predefined training cases: a JSON array,\n"
+"                             JSON objects one per line or the text layout\n"
+"                             of test_cases.txt.\n"
 "\n"
 "  -p <port number>,          Specify a TCP port number at which to expect\n"
 "    --port=<port number>     connections; 12345 by default.\n"
@@ -55,7 +59,9 @@ void help(pcstr name) {
 "                             in this case (delim: ` ,;@`).\n"
 "\n"
 "  --dump-session[            An export routine that dumps current training\n"
-"      =dump/file/path]       session data intoJSON file of stdout.\n"
+"      =dump/file/path]       session data intoJSON file of stdout; sampling\n"
+"                             a large population is offered only when\n"
+"                             stdout is a terminal.\n"
 "\n"
 "  --no-exit                  Execution control flag that requires trainer\n"
 "                             server to keep running after the export routines\n"
@@ -63,7 +69,80 @@ void help(pcstr name) {
 "\n"
 "  -d <path/to/dir>           This is the directory where session data is to be\n"
 "    --directory=<...>        located; also this is a destination for replays\n"
-"                             exporter."
+"                             exporter.\n"
+"\n"
+"  --fitness-cache=<entries>  Remember per-case ratings of that many recently\n"
+"                             evaluated genomes, so duplicate children are\n"
+"                             not simulated again; 4096 by default,\n"
+"                             0 disables the cache.\n"
+"\n"
+"  --steady-state[=<evals>]   Evolve without a generation barrier: once the\n"
+"                             population has been evaluated, every finished\n"
+"                             offspring is bred a replacement right away and\n"
+"                             takes the place of the worst individual, when\n"
+"                             it is better. Training state is persisted every\n"
+"                             <evals> evaluations (population size by\n"
+"                             default).\n"
+"\n"
+"  --island=<host:port>[,...] Run as one island of a federation: trainers at\n"
+"                             given addresses receive the best individuals\n"
+"                             of this one periodically (delim: ` ,;`).\n"
+"\n"
+"  --island-id=<id>           Name of this island in migrants it sends; a\n"
+"                             random one by default.\n"
+"\n"
+"  --migration=<K>[;<k>]      Send top <k> individuals to other islands every\n"
+"                             <K> generations; 10;4 by default.\n"
+"\n"
+"  --racing=<m>[;<keep>]      Evaluate genomes in stages, on a growing random\n"
+"                             window of cases starting with <m> of them: after\n"
+"                             each stage only <keep> fraction of the best ones\n"
+"                             carry on, the rest get the worst rating; <keep>\n"
+"                             is .5 by default, <m> of 0 disables racing.\n"
+"\n"
+"  --surrogate=<f>[;<lambda>] Breed <f> times as many children as needed and\n"
+"                             evaluate only the ones scored best by a ridge\n"
+"                             regression (penalty <lambda>, 1 by default)\n"
+"                             fitted on all the genomes evaluated so far.\n"
+"\n"
+"  --speculation=<n>[;<c>]    Once no more than <n> genomes of a generation\n"
+"                             remain unfinished, hand out up to <c> extra\n"
+"                             copies of each to idle runners instead of\n"
+"                             waiting for a timeout; the first rating wins.\n"
+"                             <c> is 1 by default; disabled by default.\n"
+"\n"
+"  --work-unit=<ms>           Split cases of a genome into blocks handed out\n"
+"                             separately, each taking about <ms> milliseconds\n"
+"                             to run as measured on runners; 0 (the default)\n"
+"                             sends all the cases of a genome at once.\n"
+"\n"
+"  --coarse=<m>[;<keep>]      Rate every genome on <m> random cases at coarse\n"
+"                             fidelity first, with the controls held for two\n"
+"                             turns; only <keep> fraction of the best ones\n"
+"                             (.25 by default) are evaluated exactly, the rest\n"
+"                             get the worst rating. Replaces racing; disabled\n"
+"                             by default.\n"
+"\n"
+"  --sweep=<file>             Host a GA session per configuration of a JSON\n"
+"                             file besides the main one, e.g.\n"
+"                             [{\"population\": 200, \"elite\": 4,\n"
+"                               \"tournament\": 3, \"crossover\": \"...\",\n"
+"                               \"mutation\": \"...\"}, ...];\n"
+"                             missing fields are taken from the main session.\n"
+"                             Sessions share cases and runners fairly; their\n"
+"                             progress is appended to sweep.csv in the data\n"
+"                             directory (see -d). Session <k> is saved to\n"
+"                             training.sweep<k>.dat and .log there, and\n"
+"                             resumed from them on restart.\n"
+"\n"
+"  --checkpoint=<k>           Rewrite training.dat in full every <k> saves\n"
+"                             only; in between, append the genomes new since\n"
+"                             the last save to training.log, replayed on\n"
+"                             recovery. 10 by default, 1 always rewrites.\n"
+"\n"
+"  --history[=<file>]         Append scores, genome ids, elite ids and\n"
+"                             per-case landing rates of every generation to\n"
+"                             a columnar archive (history.bin by default).\n"
 "\n"
 "There is nowhere to file bugs.\n"
 "You're all alone, do not expect any help.\n";
@@ -72,9 +151,27 @@ void help(pcstr name) {
 }
 
 static constexpr in_port_t default_port = 12345;
+static constexpr size_t default_fitness_cache_size = 4096;
 
 void fill_defaults(trainer::app_args& args) {
   args.port = default_port;
+  args.fitness_cache_size = default_fitness_cache_size;
+  args.steady_state_persist_cadence = 0;
+  random_device rd;
+  args.island_id = fmt::format("{:08x}{:08x}", rd(), rd());
+  args.migration_interval = 10;
+  args.migration_size = 4;
+  args.racing_min_cases = 0;
+  args.racing_keep = .5;
+  args.surrogate_factor = 0;
+  args.surrogate_lambda = 1.;
+  args.speculation_threshold = 0;
+  args.speculation_copies = 1;
+  args.work_unit_ms = 0;
+  args.coarse_cases = 0;
+  args.coarse_keep = .25;
+  args.checkpoint_interval = 10;
+  args.history_path = "history.bin";
   args.replay_case_id = 0;
   args.replay_gene_id = 0;
 }
@@ -85,6 +182,19 @@ void parse_options(int argc, const pstr* argv, trainer::app_args& args) {
   constexpr int export_dump_session_ind = 4;
   constexpr int no_exit_ind = 5;
   constexpr int directory_ind = 6;
+  constexpr int fitness_cache_ind = 7;
+  constexpr int steady_state_ind = 8;
+  constexpr int island_ind = 9;
+  constexpr int migration_ind = 10;
+  constexpr int racing_ind = 11;
+  constexpr int surrogate_ind = 12;
+  constexpr int speculation_ind = 13;
+  constexpr int work_unit_ind = 14;
+  constexpr int sweep_ind = 15;
+  constexpr int coarse_ind = 16;
+  constexpr int checkpoint_ind = 17;
+  constexpr int island_id_ind = 18;
+  constexpr int history_ind = 19;
   struct option opts[] = {
     {"help", no_argument, nullptr, 0},
     {"init", optional_argument, &args.init_flag, init_ind},
@@ -93,6 +203,19 @@ void parse_options(int argc, const pstr* argv, trainer::app_args& args) {
     {"dump-session", optional_argument, &args.export_dump_session_flag, export_dump_session_ind},
     {"no-exit", no_argument, &args.no_exit_flag, no_exit_ind},
     {"directory", required_argument, nullptr, 'd'},
+    {"fitness-cache", required_argument, nullptr, 0},
+    {"steady-state", optional_argument, &args.steady_state_flag, steady_state_ind},
+    {"island", required_argument, nullptr, 0},
+    {"migration", required_argument, nullptr, 0},
+    {"racing", required_argument, nullptr, 0},
+    {"surrogate", required_argument, nullptr, 0},
+    {"speculation", required_argument, nullptr, 0},
+    {"work-unit", required_argument, nullptr, 0},
+    {"sweep", required_argument, nullptr, 0},
+    {"coarse", required_argument, nullptr, 0},
+    {"checkpoint", required_argument, nullptr, 0},
+    {"island-id", required_argument, nullptr, 0},
+    {"history", optional_argument, &args.history_flag, history_ind},
     { NULL, 0, NULL, 0 }
   };
 
@@ -118,6 +241,60 @@ void parse_options(int argc, const pstr* argv, trainer::app_args& args) {
             break;
           }
           case no_exit_ind: break;
+          case fitness_cache_ind: {
+            if (!args.parse_fitness_cache_optarg(optarg)) goto help;
+            break;
+          }
+          case steady_state_ind: {
+            if (optarg && !args.parse_steady_state_optarg(optarg)) goto help;
+            break;
+          }
+          case island_ind: {
+            if (!args.parse_island_optarg(optarg, " ,;")) goto help;
+            break;
+          }
+          case migration_ind: {
+            if (!args.parse_migration_optarg(optarg)) goto help;
+            break;
+          }
+          case racing_ind: {
+            if (!args.parse_racing_optarg(optarg)) goto help;
+            break;
+          }
+          case surrogate_ind: {
+            if (!args.parse_surrogate_optarg(optarg)) goto help;
+            break;
+          }
+          case speculation_ind: {
+            if (!args.parse_speculation_optarg(optarg)) goto help;
+            break;
+          }
+          case work_unit_ind: {
+            if (!args.parse_work_unit_optarg(optarg)) goto help;
+            break;
+          }
+          case sweep_ind: {
+            if (!optarg) goto help;
+            args.sweep_path = optarg;
+            break;
+          }
+          case coarse_ind: {
+            if (!args.parse_coarse_optarg(optarg)) goto help;
+            break;
+          }
+          case checkpoint_ind: {
+            if (!args.parse_checkpoint_optarg(optarg)) goto help;
+            break;
+          }
+          case island_id_ind: {
+            if (!optarg || !*optarg) goto help;
+            args.island_id = optarg;
+            break;
+          }
+          case history_ind: {
+            if (optarg) args.history_path = optarg;
+            break;
+          }
           default: goto help;
         }
         break;